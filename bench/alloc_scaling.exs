@@ -0,0 +1,121 @@
+# Measures how allocating and freeing shared memory scales with the number
+# of online schedulers and concurrently allocating processes.
+#
+# Usage:
+#
+#     mix run bench/alloc_scaling.exs [options]
+#
+# Options:
+#   --schedulers N   - the highest number of online schedulers to test
+#                      (default: all available)
+#   --processes M    - the highest number of allocating processes to test
+#                      (default: 4 * schedulers)
+#   --duration MS    - duration of a single run in milliseconds (default: 1000)
+#   --capacity BYTES - capacity of allocated segments (default: 4096)
+#   --gc-every K     - number of allocations after which a process runs GC,
+#                      releasing guards and unlinking the segments (default: 64)
+#
+# Both schedulers and processes are swept in powers of two. For each run,
+# allocations per second, the number of `shm_open` retries caused by name
+# collisions and the average time spent in `shm_open`, `ftruncate` and
+# `shm_unlink` are reported. Growing syscall times with a constant amount of
+# work per call indicate contention on the tmpfs directory lock.
+defmodule Shmex.Bench.AllocScaling do
+  alias Shmex.Native
+
+  @switches [
+    schedulers: :integer,
+    processes: :integer,
+    duration: :integer,
+    capacity: :integer,
+    gc_every: :integer
+  ]
+
+  def run(argv) do
+    {opts, _args} = OptionParser.parse!(argv, strict: @switches)
+    max_schedulers = Keyword.get(opts, :schedulers, System.schedulers())
+    max_processes = Keyword.get(opts, :processes, 4 * max_schedulers)
+
+    config = %{
+      duration: Keyword.get(opts, :duration, 1000),
+      capacity: Keyword.get(opts, :capacity, 4096),
+      gc_every: Keyword.get(opts, :gc_every, 64)
+    }
+
+    initial_schedulers = System.schedulers_online()
+
+    IO.puts(
+      "schedulers processes    allocs/s  retries failures  open_us  ftrunc_us  unlink_us  wait_us"
+    )
+
+    for schedulers <- powers_of_two(max_schedulers),
+        processes <- powers_of_two(max_processes) do
+      :erlang.system_flag(:schedulers_online, schedulers)
+      result = measure(processes, config)
+      print_result(schedulers, processes, result)
+    end
+
+    :erlang.system_flag(:schedulers_online, initial_schedulers)
+  end
+
+  defp measure(processes, config) do
+    :ok = Native.reset_alloc_stats()
+    start = System.monotonic_time(:millisecond)
+    deadline = start + config.duration
+
+    1..processes
+    |> Enum.map(fn _i -> Task.async(fn -> worker(deadline, config) end) end)
+    |> Enum.each(&Task.await(&1, :infinity))
+
+    # workers finish their last batch after the deadline, so the actual
+    # duration is longer than the configured one
+    duration = System.monotonic_time(:millisecond) - start
+    {:ok, stats} = Native.alloc_stats()
+    Map.put(stats, :duration, duration)
+  end
+
+  defp worker(deadline, config) do
+    if System.monotonic_time(:millisecond) < deadline do
+      Enum.each(1..config.gc_every, fn _i ->
+        {:ok, _shm} = Native.allocate(%Shmex{capacity: config.capacity})
+      end)
+
+      :erlang.garbage_collect()
+      worker(deadline, config)
+    else
+      :erlang.garbage_collect()
+    end
+  end
+
+  defp print_result(schedulers, processes, stats) do
+    allocs_per_s = stats.allocations * 1000 / stats.duration
+
+    [
+      pad(schedulers, 10),
+      pad(processes, 10),
+      pad(round(allocs_per_s), 11),
+      pad(stats.name_retries, 8),
+      pad(stats.failures, 8),
+      pad(avg_us(stats.shm_open_ns, stats.allocations + stats.failures), 8),
+      pad(avg_us(stats.ftruncate_ns, stats.allocations), 10),
+      pad(avg_us(stats.unlink_ns, stats.unlinks), 10),
+      pad(avg_us(stats.unlink_wait_ns, stats.unlinks), 8)
+    ]
+    |> Enum.join(" ")
+    |> IO.puts()
+  end
+
+  defp avg_us(_total_ns, 0), do: 0.0
+  defp avg_us(total_ns, count), do: Float.round(total_ns / count / 1000, 2)
+
+  defp pad(value, width), do: value |> to_string() |> String.pad_leading(width)
+
+  defp powers_of_two(max) do
+    1
+    |> Stream.iterate(&(&1 * 2))
+    |> Enum.take_while(&(&1 < max))
+    |> Enum.concat([max])
+  end
+end
+
+Shmex.Bench.AllocScaling.run(System.argv())
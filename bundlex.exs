@@ -2,41 +2,76 @@ defmodule Shmex.BundlexProject do
   use Bundlex.Project
 
   def project do
+    trace_flags = trace_flags()
+
     [
-      natives: natives(),
-      libs: libs()
+      natives: natives(trace_flags),
+      libs: libs(trace_flags)
     ]
   end
 
-  defp natives() do
+  defp natives(trace_flags) do
     [
       shmex: [
         interface: :nif,
         deps: [shmex: :shmex, bunch_native: :bunch],
-        sources: ["shmex.c"]
+        sources: ["shmex.c"],
+        compiler_flags: trace_flags
       ]
     ]
   end
 
-  defp libs() do
+  defp libs(trace_flags) do
     [
       lib: [
         src_base: "shmex/shmex",
         sources: ["lib.c"],
-        libs: if(Bundlex.get_target().os == "linux", do: ["rt"], else: [])
+        libs: if(Bundlex.get_target().os == "linux", do: ["rt"], else: []),
+        compiler_flags: trace_flags
       ],
       shmex: [
         interface: :nif,
         deps: [shmex: :lib, bunch_native: :bunch],
         src_base: "shmex/nif/shmex",
-        sources: ["shmex.c"]
+        sources: ["shmex.c"],
+        compiler_flags: trace_flags
       ],
       shmex: [
         interface: :cnode,
         deps: [shmex: :lib],
         src_base: "shmex/cnode/shmex",
-        sources: ["shmex.c"]
+        sources: ["shmex.c"],
+        compiler_flags: trace_flags
       ]
     ]
   end
+
+  # Tracepoints (see c_src/shmex/shmex/trace.h) need <sys/sdt.h> at compile time.
+  # Building without them is reported, unless requested with SHMEX_NO_TRACE=1.
+  defp trace_flags() do
+    cond do
+      System.get_env("SHMEX_NO_TRACE") not in [nil, "", "0"] ->
+        ["-DSHMEX_NO_TRACE"]
+
+      sdt_available?() ->
+        []
+
+      true ->
+        IO.warn(
+          "<sys/sdt.h> not found, Shmex is built without tracepoints. Install it " <>
+            "(e.g. systemtap-sdt-dev or systemtap-sdt-devel package) or set " <>
+            "SHMEX_NO_TRACE=1 to build without tracepoints deliberately",
+          []
+        )
+
+        ["-DSHMEX_NO_TRACE"]
+    end
+  end
+
+  defp sdt_available?() do
+    {_output, status} =
+      System.shell("echo '#include <sys/sdt.h>' | cc -E -x c - > /dev/null 2>&1")
+
+    status == 0
+  end
 end
@@ -39,7 +39,10 @@ static int try_decode_nil(const char *buf, int *idx_ptr, int *nil) {
 void shmex_init(Shmex *payload, unsigned capacity) {
   payload->size = 0;
   payload->capacity = capacity;
+  payload->offset = 0;
+  payload->frozen = 0;
   payload->mapped_memory = MAP_FAILED;
+  payload->mapped_writable = 0;
   payload->name = NULL;
   payload->guard = NULL;
 }
@@ -76,72 +79,193 @@ int shmex_serialize(ei_x_buff *buf, Shmex *payload) {
          ei_x_encode_ulong(buf, (unsigned long)payload->size) ||
          ei_x_encode_atom(buf, "capacity") ||
          ei_x_encode_ulong(buf, (unsigned long)payload->capacity) ||
+         ei_x_encode_atom(buf, "offset") ||
+         ei_x_encode_ulong(buf, (unsigned long)payload->offset) ||
+         ei_x_encode_atom(buf, "frozen") ||
+         ei_x_encode_boolean(buf, payload->frozen) ||
          ei_x_encode_atom(buf, "__struct__") ||
          ei_x_encode_atom(buf, SHMEX_ELIXIR_STRUCT_ATOM);
 }
 
-int shmex_deserialize(const char *buf, int *idx, Shmex *payload) {
-  int map_size;
-  if (ei_decode_map_header(buf, idx, &map_size) ||
-      map_size != SHMEX_ELIXIR_STRUCT_ENTRIES) {
+/**
+ * Serializes Shmex C struct into the compact form:
+ * `{:shmex, name, guard, size, capacity, offset, frozen}`, that can be
+ * converted to Shmex Elixir struct with `Shmex.from_compact/1`.
+ */
+int shmex_serialize_compact(ei_x_buff *buf, Shmex *payload) {
+  return ei_x_encode_tuple_header(buf, SHMEX_COMPACT_ENTRIES) ||
+         ei_x_encode_atom(buf, SHMEX_COMPACT_ATOM) ||
+         (payload->name
+              ? ei_x_encode_binary(buf, payload->name, strlen(payload->name))
+              : ei_x_encode_atom(buf, "nil")) ||
+         (payload->guard ? ei_x_encode_ref(buf, payload->guard)
+                         : ei_x_encode_atom(buf, "nil")) ||
+         ei_x_encode_ulong(buf, (unsigned long)payload->size) ||
+         ei_x_encode_ulong(buf, (unsigned long)payload->capacity) ||
+         ei_x_encode_ulong(buf, (unsigned long)payload->offset) ||
+         ei_x_encode_boolean(buf, payload->frozen);
+}
+
+static int decode_name(const char *buf, int *idx, Shmex *payload,
+                       ShmexStorage *storage) {
+  int is_nil, type, size;
+  long name_len;
+  if (try_decode_nil(buf, idx, &is_nil)) {
+    return 1;
+  }
+  if (is_nil) {
+    payload->name = NULL;
     return 0;
   }
+  if (ei_get_type(buf, idx, &type, &size) || type != ERL_BINARY_EXT ||
+      size > NAME_MAX) {
+    return 1;
+  }
+  if (ei_decode_binary(buf, idx, storage->name, &name_len)) {
+    return 1;
+  }
+  storage->name[name_len] = '\0';
+  payload->name = storage->name;
+  return 0;
+}
 
-  shmex_init(payload, 0);
-
-  unsigned long tmp_size;
+static int decode_guard(const char *buf, int *idx, Shmex *payload,
+                        ShmexStorage *storage) {
   int is_nil;
+  if (try_decode_nil(buf, idx, &is_nil)) {
+    return 1;
+  }
+  if (is_nil) {
+    payload->guard = NULL;
+    return 0;
+  }
+  if (ei_decode_ref(buf, idx, &storage->guard)) {
+    return 1;
+  }
+  payload->guard = &storage->guard;
+  return 0;
+}
+
+static int decode_uint(const char *buf, int *idx, unsigned *value) {
+  unsigned long tmp;
+  if (ei_decode_ulong(buf, idx, &tmp)) {
+    return 1;
+  }
+  *value = (unsigned)tmp;
+  return 0;
+}
+
+static int decode_compact(const char *buf, int *idx, Shmex *payload,
+                          ShmexStorage *storage) {
+  int arity;
+  char tag[MAXATOMLEN];
+  return ei_decode_tuple_header(buf, idx, &arity) ||
+         arity != SHMEX_COMPACT_ENTRIES || ei_decode_atom(buf, idx, tag) ||
+         strcmp(tag, SHMEX_COMPACT_ATOM) ||
+         decode_name(buf, idx, payload, storage) ||
+         decode_guard(buf, idx, payload, storage) ||
+         decode_uint(buf, idx, &payload->size) ||
+         decode_uint(buf, idx, &payload->capacity) ||
+         decode_uint(buf, idx, &payload->offset) ||
+         ei_decode_boolean(buf, idx, &payload->frozen);
+}
+
+/**
+ * Decodes the Elixir struct form. Offset and frozen flag, absent in structs
+ * created before they were introduced, default to 0 and false, while unknown
+ * keys are skipped.
+ */
+static int decode_map(const char *buf, int *idx, Shmex *payload,
+                      ShmexStorage *storage) {
+  int map_size;
+  if (ei_decode_map_header(buf, idx, &map_size)) {
+    return 1;
+  }
 
-  for (int i = 0; i < SHMEX_ELIXIR_STRUCT_ENTRIES; i++) {
-    char key[NAME_MAX];
-    ei_decode_atom(buf, idx, key);
+  // name, guard, size and capacity are required
+  int required_found = 0;
+  for (int i = 0; i < map_size; i++) {
+    char key[MAXATOMLEN];
+    if (ei_decode_atom(buf, idx, key)) {
+      return 1;
+    }
+    int res;
     if (!strcmp(key, "name")) {
-      if (try_decode_nil(buf, idx, &is_nil)) {
-        goto shmex_deserialize_error;
-      }
-      if (!is_nil) {
-        char name[NAME_MAX];
-        long name_len;
-        if (ei_decode_binary(buf, idx, name, &name_len)) {
-          goto shmex_deserialize_error;
-        }
-        payload->name = malloc(name_len + 1);
-        snprintf(payload->name, name_len + 1, "%s", name);
-      }
+      res = decode_name(buf, idx, payload, storage);
+      required_found++;
     } else if (!strcmp(key, "guard")) {
-      if (try_decode_nil(buf, idx, &is_nil)) {
-        goto shmex_deserialize_error;
-      }
-      if (!is_nil) {
-        payload->guard = malloc(sizeof(erlang_ref));
-        if (ei_decode_ref(buf, idx, payload->guard)) {
-          goto shmex_deserialize_error;
-        }
-      }
+      res = decode_guard(buf, idx, payload, storage);
+      required_found++;
     } else if (!strcmp(key, "size")) {
-      if (ei_decode_ulong(buf, idx, &tmp_size)) {
-        goto shmex_deserialize_error;
-      }
-      payload->size = (int)tmp_size;
+      res = decode_uint(buf, idx, &payload->size);
+      required_found++;
     } else if (!strcmp(key, "capacity")) {
-      if (ei_decode_ulong(buf, idx, &tmp_size)) {
-        goto shmex_deserialize_error;
-      }
-      payload->capacity = (int)tmp_size;
+      res = decode_uint(buf, idx, &payload->capacity);
+      required_found++;
+    } else if (!strcmp(key, "offset")) {
+      res = decode_uint(buf, idx, &payload->offset);
+    } else if (!strcmp(key, "frozen")) {
+      res = ei_decode_boolean(buf, idx, &payload->frozen);
     } else if (!strcmp(key, "__struct__")) {
-      char struct_name[NAME_MAX];
-      if (ei_decode_atom(buf, idx, struct_name) ||
-          strcmp(struct_name, SHMEX_ELIXIR_STRUCT_ATOM)) {
-        goto shmex_deserialize_error;
-      }
+      char struct_name[MAXATOMLEN];
+      res = ei_decode_atom(buf, idx, struct_name) ||
+            strcmp(struct_name, SHMEX_ELIXIR_STRUCT_ATOM);
     } else {
-      goto shmex_deserialize_error;
+      res = ei_skip_term(buf, idx);
+    }
+    if (res) {
+      return 1;
     }
   }
+  return required_found != 4;
+}
 
-  return 0;
+/**
+ * Decodes Shmex struct, either in the Elixir struct form or in the compact
+ * form (see `shmex_serialize_compact`), without allocating memory.
+ *
+ * Name and guard are stored in `storage` and the payload points to them,
+ * so the storage has to outlive the payload. Payload decoded this way must
+ * not be passed to `shmex_release` - use `shmex_unmap` instead.
+ */
+int shmex_deserialize_into(const char *buf, int *idx, Shmex *payload,
+                           ShmexStorage *storage) {
+  int type, size;
+  shmex_init(payload, 0);
+  if (ei_get_type(buf, idx, &type, &size)) {
+    return 1;
+  }
+
+  int res = type == ERL_SMALL_TUPLE_EXT
+                ? decode_compact(buf, idx, payload, storage)
+                : decode_map(buf, idx, payload, storage);
+  if (res) {
+    payload->name = NULL;
+    payload->guard = NULL;
+  }
+  return res;
+}
+
+/**
+ * Decodes Shmex struct, either in the Elixir struct form or in the compact
+ * form (see `shmex_serialize_compact`).
+ *
+ * Each successful call should be paired with `shmex_release` call
+ * to deallocate resources.
+ */
+int shmex_deserialize(const char *buf, int *idx, Shmex *payload) {
+  ShmexStorage storage;
+  if (shmex_deserialize_into(buf, idx, payload, &storage)) {
+    return 1;
+  }
 
-shmex_deserialize_error:
-  shmex_release(payload);
-  return 1;
+  if (payload->name != NULL) {
+    payload->name = malloc(strlen(storage.name) + 1);
+    strcpy(payload->name, storage.name);
+  }
+  if (payload->guard != NULL) {
+    payload->guard = malloc(sizeof(erlang_ref));
+    *payload->guard = storage.guard;
+  }
+  return 0;
 }
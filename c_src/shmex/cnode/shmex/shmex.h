@@ -4,8 +4,20 @@
 
 #define NAME_MAX 255
 
+/**
+ * Storage for name and guard of payloads decoded with
+ * `shmex_deserialize_into`.
+ */
+typedef struct {
+  char name[NAME_MAX + 1];
+  erlang_ref guard;
+} ShmexStorage;
+
 void shmex_init(Shmex *payload, unsigned capacity);
 int shmex_deserialize(const char *buf, int *idx, Shmex *payload);
+int shmex_deserialize_into(const char *buf, int *idx, Shmex *payload,
+                           ShmexStorage *storage);
 void shmex_release(Shmex *payload);
 int shmex_serialize(ei_x_buff *buf, Shmex *payload);
+int shmex_serialize_compact(ei_x_buff *buf, Shmex *payload);
 // ERL_NIF_TERM shmex_make_error_term(ErlNifEnv * env, ShmexLibResult result);
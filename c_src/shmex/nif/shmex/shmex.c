@@ -1,5 +1,6 @@
 #include <fcntl.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
@@ -17,10 +18,23 @@ void shmex_init(ErlNifEnv *env, Shmex *payload, unsigned capacity) {
   payload->guard = enif_make_atom(env, "nil");
   payload->size = 0;
   payload->capacity = capacity;
+  payload->offset = 0;
+  payload->frozen = 0;
   payload->mapped_memory = MAP_FAILED;
+  payload->mapped_writable = 0;
   payload->name = NULL;
 }
 
+static void add_guard(ErlNifEnv *env, ErlNifResourceType *guard_type,
+                      Shmex *payload, int accounted) {
+  ShmexGuard *guard = enif_alloc_resource(guard_type, sizeof(*guard));
+  strcpy(guard->name, payload->name);
+  guard->accounted = accounted;
+  guard->accounted_size = accounted ? payload->capacity : 0;
+  payload->guard = enif_make_resource(env, guard);
+  enif_release_resource(guard);
+}
+
 /**
  * Allocates shared memory using `shmex_allocate_unguarded` and adds guard to it
  * with `shmex_add_guard`.
@@ -31,7 +45,7 @@ ShmexLibResult shmex_allocate(ErlNifEnv *env, ErlNifResourceType *guard_type,
   if (SHMEX_RES_OK != result) {
     return result;
   }
-  shmex_add_guard(env, guard_type, payload);
+  add_guard(env, guard_type, payload, 1);
   return SHMEX_RES_OK;
 }
 
@@ -42,10 +56,26 @@ ShmexLibResult shmex_allocate(ErlNifEnv *env, ErlNifResourceType *guard_type,
  */
 void shmex_add_guard(ErlNifEnv *env, ErlNifResourceType *guard_type,
                      Shmex *payload) {
-  ShmexGuard *guard = enif_alloc_resource(guard_type, sizeof(*guard));
-  strcpy(guard->name, payload->name);
-  payload->guard = enif_make_resource(env, guard);
-  enif_release_resource(guard);
+  add_guard(env, guard_type, payload, 0);
+}
+
+/**
+ * Sets the capacity of shared memory payload with
+ * 'shmex_set_capacity_accounted' if the payload is guarded by a guard created
+ * with 'shmex_allocate', so that the change is reflected in the usage of shared
+ * memory and in the size released by the guard, and with
+ * 'shmex_set_capacity_unaccounted' otherwise.
+ */
+ShmexLibResult shmex_set_capacity_guarded(ErlNifEnv *env,
+                                          ErlNifResourceType *guard_type,
+                                          Shmex *payload, size_t capacity) {
+  ShmexGuard *guard;
+  if (enif_get_resource(env, payload->guard, guard_type, (void **)&guard) &&
+      guard->accounted) {
+    return shmex_set_capacity_accounted(payload, capacity,
+                                        &guard->accounted_size);
+  }
+  return shmex_set_capacity_unaccounted(payload, capacity);
 }
 
 /**
@@ -58,59 +88,209 @@ void shmex_guard_destructor(ErlNifEnv *env, void *resource) {
 
   ShmexGuard *guard = (ShmexGuard *)resource;
   shmex_shm_unlink(guard->name);
+  if (guard->accounted) {
+    shmex_release_usage(guard->accounted_size);
+  }
+}
+
+/**
+ * Creates a slab: a single shared memory segment divided into `chunk_count`
+ * chunks of `chunk_size` bytes (rounded up to `SHMEX_SLAB_CHUNK_ALIGN`),
+ * that can be handed out with `shmex_slab_allocate`.
+ *
+ * The first page of the segment is left unused, so that each chunk has
+ * a non-zero offset, which distinguishes chunks from standalone segments.
+ * The segment is unlinked once the slab and all its chunks are garbage
+ * collected.
+ */
+ShmexLibResult shmex_slab_create(ErlNifEnv *env, ErlNifResourceType *slab_type,
+                                 unsigned chunk_size, unsigned chunk_count,
+                                 ERL_NIF_TERM *slab_term) {
+  unsigned header_size = sysconf(_SC_PAGESIZE);
+  chunk_size = (chunk_size + SHMEX_SLAB_CHUNK_ALIGN - 1) /
+               SHMEX_SLAB_CHUNK_ALIGN * SHMEX_SLAB_CHUNK_ALIGN;
+
+  Shmex payload;
+  shmex_init(env, &payload, header_size + chunk_size * chunk_count);
+  ShmexLibResult result = shmex_allocate_unguarded(&payload);
+  if (SHMEX_RES_OK != result) {
+    shmex_release(&payload);
+    return result;
+  }
+
+  ShmexSlab *slab = enif_alloc_resource(slab_type, sizeof(*slab));
+  strcpy(slab->name, payload.name);
+  slab->header_size = header_size;
+  slab->chunk_size = chunk_size;
+  slab->chunk_count = chunk_count;
+  slab->lock = enif_mutex_create("shmex_slab_lock");
+  slab->free_chunks = enif_alloc(chunk_count * sizeof(*slab->free_chunks));
+  // chunks are taken from the end, so that they are handed out in order
+  for (unsigned i = 0; i < chunk_count; i++) {
+    slab->free_chunks[i] = chunk_count - 1 - i;
+  }
+  slab->free_count = chunk_count;
+
+  *slab_term = enif_make_resource(env, slab);
+  enif_release_resource(slab);
+  shmex_release(&payload);
+  return SHMEX_RES_OK;
+}
+
+/**
+ * Takes a free chunk from the slab and initializes the payload with it.
+ *
+ * The payload gets a chunk guard, that returns the chunk to the slab once
+ * garbage collected. The chunk's content is not cleared, so it may contain
+ * data left by its previous user. Fails with `SHMEX_ERROR_SLAB_FULL` when
+ * there are no free chunks.
+ *
+ * Each successful call should be paired with `shmex_release` call to
+ * deallocate resources.
+ */
+ShmexLibResult shmex_slab_allocate(ErlNifEnv *env,
+                                   ErlNifResourceType *chunk_guard_type,
+                                   ShmexSlab *slab, Shmex *payload) {
+  enif_mutex_lock(slab->lock);
+  if (slab->free_count == 0) {
+    enif_mutex_unlock(slab->lock);
+    return SHMEX_ERROR_SLAB_FULL;
+  }
+  unsigned index = slab->free_chunks[--slab->free_count];
+  enif_mutex_unlock(slab->lock);
+
+  ShmexSlabChunkGuard *guard =
+      enif_alloc_resource(chunk_guard_type, sizeof(*guard));
+  enif_keep_resource(slab);
+  guard->slab = slab;
+  guard->index = index;
+
+  payload->name = malloc(strlen(slab->name) + 1);
+  strcpy(payload->name, slab->name);
+  payload->offset = slab->header_size + index * slab->chunk_size;
+  payload->capacity = slab->chunk_size;
+  payload->size = 0;
+  payload->guard = enif_make_resource(env, guard);
+  enif_release_resource(guard);
+  return SHMEX_RES_OK;
 }
 
 /**
- * Initializes Shmex C struct using data from Shmex Elixir struct
+ * Destructor for slabs.
+ *
+ * It is to be passed as a destructor to `enif_open_resource_type` function.
+ */
+void shmex_slab_destructor(ErlNifEnv *env, void *resource) {
+  BUNCH_UNUSED(env);
+
+  ShmexSlab *slab = (ShmexSlab *)resource;
+  shmex_shm_unlink(slab->name);
+  shmex_release_usage(slab->header_size +
+                      slab->chunk_size * slab->chunk_count);
+  enif_mutex_destroy(slab->lock);
+  enif_free(slab->free_chunks);
+}
+
+/**
+ * Destructor for slab chunk guards. Returns the chunk to its slab.
+ *
+ * It is to be passed as a destructor to `enif_open_resource_type` function.
+ */
+void shmex_slab_chunk_guard_destructor(ErlNifEnv *env, void *resource) {
+  BUNCH_UNUSED(env);
+
+  ShmexSlabChunkGuard *guard = (ShmexSlabChunkGuard *)resource;
+  ShmexSlab *slab = guard->slab;
+  enif_mutex_lock(slab->lock);
+  slab->free_chunks[slab->free_count++] = guard->index;
+  enif_mutex_unlock(slab->lock);
+  enif_release_resource(slab);
+}
+
+/**
+ * Gets the terms of Shmex fields from the compact tuple representation
+ * (see `Shmex.to_compact/1`). Returns 0 if the term is not a compact Shmex.
+ */
+static int get_compact_fields(ErlNifEnv *env, ERL_NIF_TERM term,
+                              ERL_NIF_TERM fields[]) {
+  int arity;
+  const ERL_NIF_TERM *elements;
+  if (!enif_get_tuple(env, term, &arity, &elements) ||
+      arity != SHMEX_COMPACT_ENTRIES ||
+      !enif_is_identical(elements[0],
+                         enif_make_atom(env, SHMEX_COMPACT_ATOM))) {
+    return 0;
+  }
+  for (int i = 1; i < SHMEX_COMPACT_ENTRIES; i++) {
+    fields[i - 1] = elements[i];
+  }
+  return 1;
+}
+
+/**
+ * Gets the terms of Shmex fields from the Elixir struct. Offset and frozen
+ * flag, absent in structs created before they were introduced, default to
+ * 0 and false. Returns 0 if any other field is missing.
+ */
+static int get_map_fields(ErlNifEnv *env, ERL_NIF_TERM term,
+                          ERL_NIF_TERM fields[]) {
+  const char *keys[] = {"name", "guard", "size", "capacity", "offset",
+                        "frozen"};
+  for (int i = 0; i < 6; i++) {
+    if (!enif_get_map_value(env, term, enif_make_atom(env, keys[i]),
+                            &fields[i])) {
+      if (i < 4) {
+        return 0;
+      }
+      fields[i] =
+          i == 4 ? enif_make_uint(env, 0) : enif_make_atom(env, "false");
+    }
+  }
+  return 1;
+}
+
+/**
+ * Initializes Shmex C struct using data from Shmex Elixir struct or its
+ * compact representation (see `Shmex.to_compact/1`)
  *
  * Each call should be paired with `shmex_release` call to deallocate resources
  */
 int shmex_get_from_term(ErlNifEnv *env, ERL_NIF_TERM struct_term,
                         Shmex *payload) {
-  const ERL_NIF_TERM ATOM_NAME = enif_make_atom(env, "name");
-  const ERL_NIF_TERM ATOM_GUARD = enif_make_atom(env, "guard");
-  const ERL_NIF_TERM ATOM_SIZE = enif_make_atom(env, "size");
-  const ERL_NIF_TERM ATOM_CAPACITY = enif_make_atom(env, "capacity");
-
+  // name, guard, size, capacity, offset, frozen
+  ERL_NIF_TERM fields[SHMEX_COMPACT_ENTRIES - 1];
   int result;
-  ERL_NIF_TERM tmp_term;
 
   payload->mapped_memory = MAP_FAILED;
+  payload->mapped_writable = 0;
 
-  // Get guard
-  result = enif_get_map_value(env, struct_term, ATOM_GUARD, &tmp_term);
-  if (!result) {
+  if (!get_compact_fields(env, struct_term, fields) &&
+      !get_map_fields(env, struct_term, fields)) {
     return 0;
   }
-  payload->guard = tmp_term;
 
-  // Get size
-  result = enif_get_map_value(env, struct_term, ATOM_SIZE, &tmp_term);
-  if (!result) {
-    return 0;
-  }
-  result = enif_get_uint(env, tmp_term, &payload->size);
+  payload->guard = fields[1];
+
+  result = enif_get_uint(env, fields[2], &payload->size);
   if (!result) {
     return 0;
   }
 
-  // Get capacity
-  result = enif_get_map_value(env, struct_term, ATOM_CAPACITY, &tmp_term);
+  result = enif_get_uint(env, fields[3], &payload->capacity);
   if (!result) {
     return 0;
   }
-  result = enif_get_uint(env, tmp_term, &payload->capacity);
+
+  result = enif_get_uint(env, fields[4], &payload->offset);
   if (!result) {
     return 0;
   }
 
+  payload->frozen = enif_is_identical(fields[5], enif_make_atom(env, "true"));
+
   // Get name as last to prevent failure after allocating memory
-  result = enif_get_map_value(env, struct_term, ATOM_NAME, &tmp_term);
-  if (!result) {
-    return 0;
-  }
   char atom_tmp[4];
-  result = enif_get_atom(env, tmp_term, atom_tmp, 4, ERL_NIF_LATIN1);
+  result = enif_get_atom(env, fields[0], atom_tmp, 4, ERL_NIF_LATIN1);
   if (result) {
     if (strncmp(atom_tmp, "nil", 3) == 0) {
       payload->name = NULL;
@@ -121,7 +301,7 @@ int shmex_get_from_term(ErlNifEnv *env, ERL_NIF_TERM struct_term,
   }
 
   ErlNifBinary name_binary;
-  result = enif_inspect_binary(env, tmp_term, &name_binary);
+  result = enif_inspect_binary(env, fields[0], &name_binary);
   if (!result) {
     return 0;
   }
@@ -155,7 +335,8 @@ ERL_NIF_TERM shmex_make_term(ErlNifEnv *env, Shmex *payload) {
   ERL_NIF_TERM keys[SHMEX_ELIXIR_STRUCT_ENTRIES] = {
       enif_make_atom(env, "__struct__"), enif_make_atom(env, "name"),
       enif_make_atom(env, "guard"), enif_make_atom(env, "size"),
-      enif_make_atom(env, "capacity")};
+      enif_make_atom(env, "capacity"), enif_make_atom(env, "offset"),
+      enif_make_atom(env, "frozen")};
 
   ERL_NIF_TERM name_term;
   unsigned name_len = strlen(payload->name);
@@ -164,7 +345,9 @@ ERL_NIF_TERM shmex_make_term(ErlNifEnv *env, Shmex *payload) {
 
   ERL_NIF_TERM values[SHMEX_ELIXIR_STRUCT_ENTRIES] = {
       enif_make_atom(env, SHMEX_ELIXIR_STRUCT_ATOM), name_term, payload->guard,
-      enif_make_int(env, payload->size), enif_make_int(env, payload->capacity)};
+      enif_make_int(env, payload->size), enif_make_int(env, payload->capacity),
+      enif_make_uint(env, payload->offset),
+      enif_make_atom(env, payload->frozen ? "true" : "false")};
 
   ERL_NIF_TERM return_term;
   int res = enif_make_map_from_arrays(
@@ -193,6 +376,22 @@ ERL_NIF_TERM shmex_make_error_term(ErlNifEnv *env, ShmexLibResult result) {
     return bunch_raise_error(env, "shm_is_mapped");
   case SHMEX_ERROR_INVALID_PAYLOAD:
     return bunch_make_error_str(env, "invalid_payload");
+  case SHMEX_ERROR_MBIND:
+    return bunch_make_error_errno(env, "mbind");
+  case SHMEX_ERROR_GET_MEMPOLICY:
+    return bunch_make_error_errno(env, "get_mempolicy");
+  case SHMEX_ERROR_FCHMOD:
+    return bunch_make_error_errno(env, "fchmod");
+  case SHMEX_ERROR_FROZEN:
+    return bunch_make_error_str(env, "frozen");
+  case SHMEX_ERROR_SLAB_CHUNK:
+    return bunch_make_error_str(env, "slab_chunk");
+  case SHMEX_ERROR_SLAB_FULL:
+    return bunch_make_error_str(env, "slab_full");
+  case SHMEX_ERROR_BUDGET_EXCEEDED:
+    return bunch_make_error_str(env, "budget_exceeded");
+  case SHMEX_ERROR_INVALID_RANGE:
+    return bunch_make_error_str(env, "invalid_range");
   default:
     return bunch_raise_error(env, "unknown");
   }
@@ -6,17 +6,48 @@
 #include <shmex/lib.h>
 
 #define NAME_MAX 255
+#define SHMEX_SLAB_CHUNK_ALIGN 64
 
 typedef struct _ShmexGuard {
   char name[NAME_MAX + 1];
+  // whether the segment is included in the usage (see `shmex_get_usage`)
+  int accounted;
+  // number of bytes the segment adds to the usage, released in the destructor
+  uint64_t accounted_size;
 } ShmexGuard;
 
+typedef struct _ShmexSlab {
+  char name[NAME_MAX + 1];
+  unsigned header_size;
+  unsigned chunk_size;
+  unsigned chunk_count;
+  ErlNifMutex *lock;
+  unsigned free_count;
+  unsigned *free_chunks;
+} ShmexSlab;
+
+typedef struct _ShmexSlabChunkGuard {
+  ShmexSlab *slab;
+  unsigned index;
+} ShmexSlabChunkGuard;
+
 void shmex_init(ErlNifEnv *env, Shmex *payload, unsigned capacity);
 ShmexLibResult shmex_allocate(ErlNifEnv *env, ErlNifResourceType *guard_type,
                               Shmex *payload);
 void shmex_add_guard(ErlNifEnv *env, ErlNifResourceType *guard_type,
                      Shmex *payload);
+ShmexLibResult shmex_set_capacity_guarded(ErlNifEnv *env,
+                                          ErlNifResourceType *guard_type,
+                                          Shmex *payload, size_t capacity);
 void shmex_guard_destructor(ErlNifEnv *env, void *resource);
+ShmexLibResult shmex_slab_create(ErlNifEnv *env, ErlNifResourceType *slab_type,
+                                 unsigned chunk_size, unsigned chunk_count,
+                                 ERL_NIF_TERM *slab_term);
+ShmexLibResult shmex_slab_allocate(ErlNifEnv *env,
+                                   ErlNifResourceType *chunk_guard_type,
+                                   ShmexSlab *slab, Shmex *payload);
+void shmex_slab_destructor(ErlNifEnv *env, void *resource);
+void shmex_slab_chunk_guard_destructor(ErlNifEnv *env, void *resource);
 int shmex_get_from_term(ErlNifEnv *env, ERL_NIF_TERM record, Shmex *payload);
 void shmex_release(Shmex *payload);
 ERL_NIF_TERM shmex_make_term(ErlNifEnv *env, Shmex *payload);
@@ -1,17 +1,134 @@
 #define NAME_MAX 255
+#ifdef __linux__
+// recvmmsg and sendmmsg
+#define _GNU_SOURCE
+#endif
 #define _POSIX_C_SOURCE 200809L
 
 #include <bunch/bunch.h>
 #include <erl_nif.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <shmex/shmex.h>
+#include <shmex/trace.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <sys/socket.h>
 #include <sys/stat.h> /* For mode constants */
+#include <sys/uio.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#define SOCKET_BATCH_MAX 1024
+#define USAGE_SUBSCRIPTIONS_MAX 64
+
 ErlNifResourceType *SHMEX_GUARD_RESOURCE_TYPE;
+ErlNifResourceType *SHMEX_SLAB_RESOURCE_TYPE;
+ErlNifResourceType *SHMEX_SLAB_CHUNK_GUARD_RESOURCE_TYPE;
+
+typedef struct {
+  ErlNifPid pid;
+  uint64_t watermark;
+  int above;
+} UsageSubscription;
+
+static UsageSubscription usage_subscriptions[USAGE_SUBSCRIPTIONS_MAX];
+static unsigned usage_subscriptions_count;
+static ErlNifMutex *usage_subscriptions_lock;
+
+typedef struct {
+  ErlNifPid pid;
+  uint64_t watermark;
+  int above;
+} UsageNotification;
+
+/**
+ * Removes the i-th subscription by moving the last one in its place. Has to be
+ * called with `usage_subscriptions_lock` held. The count is updated atomically,
+ * as it is read without the lock in `notify_usage`.
+ */
+static void remove_subscription(unsigned i) {
+  unsigned count = usage_subscriptions_count - 1;
+  usage_subscriptions[i] = usage_subscriptions[count];
+  __atomic_store_n(&usage_subscriptions_count, count, __ATOMIC_RELAXED);
+}
+
+/**
+ * Removes all subscriptions of the process. Has to be called with
+ * `usage_subscriptions_lock` held.
+ */
+static void remove_subscriptions_of(ErlNifPid *pid) {
+  for (unsigned i = 0; i < usage_subscriptions_count;) {
+    if (enif_compare_pids(&usage_subscriptions[i].pid, pid) == 0) {
+      remove_subscription(i);
+    } else {
+      i++;
+    }
+  }
+}
+
+/**
+ * Notifies subscribed processes about the usage of shared memory crossing
+ * their watermarks since the last notification. Subscriptions of processes
+ * that are no longer alive are removed.
+ *
+ * The notifications are collected under the lock and sent after releasing it,
+ * so that concurrent calls, e.g. from guard destructors, do not wait for each
+ * other's sends.
+ *
+ * Should be called whenever the usage may have changed.
+ */
+static void notify_usage(ErlNifEnv *env) {
+  if (__atomic_load_n(&usage_subscriptions_count, __ATOMIC_RELAXED) == 0) {
+    return;
+  }
+
+  UsageNotification notifications[USAGE_SUBSCRIPTIONS_MAX];
+  unsigned count = 0;
+  enif_mutex_lock(usage_subscriptions_lock);
+  uint64_t usage = shmex_get_usage();
+  for (unsigned i = 0; i < usage_subscriptions_count; i++) {
+    UsageSubscription *subscription = &usage_subscriptions[i];
+    int above = usage >= subscription->watermark;
+    if (above != subscription->above) {
+      subscription->above = above;
+      notifications[count++] = (UsageNotification){
+          subscription->pid, subscription->watermark, above};
+    }
+  }
+  enif_mutex_unlock(usage_subscriptions_lock);
+
+  if (count == 0) {
+    return;
+  }
+  ErlNifEnv *msg_env = enif_alloc_env();
+  for (unsigned i = 0; i < count; i++) {
+    UsageNotification *notification = &notifications[i];
+    ERL_NIF_TERM msg = enif_make_tuple4(
+        msg_env, enif_make_atom(msg_env, "shmex_usage"),
+        enif_make_atom(msg_env, notification->above ? "above" : "below"),
+        enif_make_uint64(msg_env, notification->watermark),
+        enif_make_uint64(msg_env, usage));
+    if (!enif_send(env, &notification->pid, msg_env, msg)) {
+      enif_mutex_lock(usage_subscriptions_lock);
+      remove_subscriptions_of(&notification->pid);
+      enif_mutex_unlock(usage_subscriptions_lock);
+    }
+    enif_clear_env(msg_env);
+  }
+  enif_free_env(msg_env);
+}
+
+static void guard_destructor(ErlNifEnv *env, void *resource) {
+  shmex_guard_destructor(env, resource);
+  notify_usage(env);
+}
+
+static void slab_destructor(ErlNifEnv *env, void *resource) {
+  shmex_slab_destructor(env, resource);
+  notify_usage(env);
+}
 
 int load(ErlNifEnv *env, void **priv_data, ERL_NIF_TERM load_info) {
   BUNCH_UNUSED(load_info);
@@ -19,7 +136,13 @@ int load(ErlNifEnv *env, void **priv_data, ERL_NIF_TERM load_info) {
 
   int flags = ERL_NIF_RT_CREATE | ERL_NIF_RT_TAKEOVER;
   SHMEX_GUARD_RESOURCE_TYPE = enif_open_resource_type(
-      env, NULL, "ShmexGuard", shmex_guard_destructor, flags, NULL);
+      env, NULL, "ShmexGuard", guard_destructor, flags, NULL);
+  SHMEX_SLAB_RESOURCE_TYPE = enif_open_resource_type(
+      env, NULL, "ShmexSlab", slab_destructor, flags, NULL);
+  SHMEX_SLAB_CHUNK_GUARD_RESOURCE_TYPE =
+      enif_open_resource_type(env, NULL, "ShmexSlabChunkGuard",
+                              shmex_slab_chunk_guard_destructor, flags, NULL);
+  usage_subscriptions_lock = enif_mutex_create("shmex_usage_subscriptions");
   return 0;
 }
 
@@ -39,6 +162,7 @@ static ERL_NIF_TERM export_allocate(ErlNifEnv *env, int argc,
   }
 
   shmex_release(&payload);
+  notify_usage(env);
   return return_term;
 }
 
@@ -47,9 +171,12 @@ static ERL_NIF_TERM export_add_guard(ErlNifEnv *env, int argc,
   BUNCH_UNUSED(argc);
   PARSE_SHMEX_ARG(0, payload);
 
-  ShmexGuard *guard;
+  void *guard;
   if (enif_get_resource(env, payload.guard, SHMEX_GUARD_RESOURCE_TYPE,
-                        (void **)&guard)) {
+                        &guard) ||
+      enif_get_resource(env, payload.guard,
+                        SHMEX_SLAB_CHUNK_GUARD_RESOURCE_TYPE, &guard)) {
+    shmex_release(&payload);
     return bunch_make_error(env, enif_make_atom(env, "already_guarded"));
   };
   shmex_add_guard(env, SHMEX_GUARD_RESOURCE_TYPE, &payload);
@@ -63,13 +190,15 @@ static ERL_NIF_TERM export_set_capacity(ErlNifEnv *env, int argc,
   BUNCH_PARSE_UINT_ARG(1, capacity);
   ERL_NIF_TERM return_term;
 
-  ShmexLibResult result = shmex_set_capacity(&payload, capacity);
+  ShmexLibResult result = shmex_set_capacity_guarded(
+      env, SHMEX_GUARD_RESOURCE_TYPE, &payload, capacity);
   if (SHMEX_RES_OK == result) {
     return_term = bunch_make_ok_tuple(env, shmex_make_term(env, &payload));
   } else {
     return_term = shmex_make_error_term(env, result);
   }
   shmex_release(&payload);
+  notify_usage(env);
   return return_term;
 }
 
@@ -85,7 +214,7 @@ static ERL_NIF_TERM export_read(ErlNifEnv *env, int argc,
     goto exit_read;
   }
 
-  ShmexLibResult result = shmex_open_and_mmap(&payload);
+  ShmexLibResult result = shmex_open_and_mmap_readonly(&payload);
   if (SHMEX_RES_OK != result) {
     return_term = shmex_make_error_term(env, result);
     goto exit_read;
@@ -93,7 +222,9 @@ static ERL_NIF_TERM export_read(ErlNifEnv *env, int argc,
 
   ERL_NIF_TERM out_bin_term;
   unsigned char *output_data = enif_make_new_binary(env, cnt, &out_bin_term);
+  SHMEX_TRACE(copy_entry, payload.name, cnt);
   memcpy(output_data, payload.mapped_memory, cnt);
+  SHMEX_TRACE(copy_return, payload.name, cnt, 0);
 
   return_term = bunch_make_ok_tuple(env, out_bin_term);
 exit_read:
@@ -108,21 +239,35 @@ static ERL_NIF_TERM export_write(ErlNifEnv *env, int argc,
   BUNCH_PARSE_BINARY_ARG(1, data);
   ERL_NIF_TERM return_term;
 
+  if (payload.frozen) {
+    return_term = shmex_make_error_term(env, SHMEX_ERROR_FROZEN);
+    goto exit_write;
+  }
+
+  ShmexLibResult result;
   if (payload.capacity < data.size) {
-    shmex_set_capacity(&payload, data.size);
+    result = shmex_set_capacity_guarded(env, SHMEX_GUARD_RESOURCE_TYPE,
+                                        &payload, data.size);
+    if (SHMEX_RES_OK != result) {
+      return_term = shmex_make_error_term(env, result);
+      goto exit_write;
+    }
   }
 
-  ShmexLibResult result = shmex_open_and_mmap(&payload);
+  result = shmex_open_and_mmap(&payload);
   if (SHMEX_RES_OK != result) {
     return_term = shmex_make_error_term(env, result);
     goto exit_write;
   }
 
+  SHMEX_TRACE(copy_entry, payload.name, data.size);
   memcpy(payload.mapped_memory, (void *)data.data, data.size);
+  SHMEX_TRACE(copy_return, payload.name, data.size, 0);
   payload.size = data.size;
   return_term = bunch_make_ok_tuple(env, shmex_make_term(env, &payload));
 exit_write:
   shmex_release(&payload);
+  notify_usage(env);
   return return_term;
 }
 
@@ -136,7 +281,7 @@ static ERL_NIF_TERM export_split_at(ErlNifEnv *env, int argc,
 
   ERL_NIF_TERM return_term;
 
-  ShmexLibResult result = shmex_open_and_mmap(&old_payload);
+  ShmexLibResult result = shmex_open_and_mmap_readonly(&old_payload);
   if (SHMEX_RES_OK != result) {
     return_term = shmex_make_error_term(env, result);
     goto exit_split_at;
@@ -158,8 +303,10 @@ static ERL_NIF_TERM export_split_at(ErlNifEnv *env, int argc,
     goto exit_split_at;
   }
 
+  SHMEX_TRACE(copy_entry, new_payload.name, new_size);
   memcpy(new_payload.mapped_memory, old_payload.mapped_memory + split_pos,
          new_size);
+  SHMEX_TRACE(copy_return, new_payload.name, new_size, 0);
 
   old_payload.size = split_pos;
 
@@ -170,6 +317,7 @@ static ERL_NIF_TERM export_split_at(ErlNifEnv *env, int argc,
 exit_split_at:
   shmex_release(&old_payload);
   shmex_release(&new_payload);
+  notify_usage(env);
   return return_term;
 }
 
@@ -181,6 +329,11 @@ static ERL_NIF_TERM export_trim_leading(ErlNifEnv *env, int argc,
   ERL_NIF_TERM return_term;
   ShmexLibResult result;
 
+  if (payload.frozen) {
+    return_term = shmex_make_error_term(env, SHMEX_ERROR_FROZEN);
+    goto exit_trim_leading;
+  }
+
   result = shmex_open_and_mmap(&payload);
   if (SHMEX_RES_OK != result) {
     return_term = shmex_make_error_term(env, result);
@@ -188,7 +341,9 @@ static ERL_NIF_TERM export_trim_leading(ErlNifEnv *env, int argc,
   }
 
   size_t new_size = payload.size - offset;
+  SHMEX_TRACE(copy_entry, payload.name, new_size);
   memmove(payload.mapped_memory, payload.mapped_memory + offset, new_size);
+  SHMEX_TRACE(copy_return, payload.name, new_size, 0);
   payload.size = new_size;
   return_term = bunch_make_ok_tuple(env, shmex_make_term(env, &payload));
 exit_trim_leading:
@@ -196,6 +351,517 @@ exit_trim_leading:
   return return_term;
 }
 
+static ERL_NIF_TERM export_fill(ErlNifEnv *env, int argc,
+                                const ERL_NIF_TERM argv[]) {
+  BUNCH_UNUSED(argc);
+  PARSE_SHMEX_ARG(0, payload);
+  BUNCH_PARSE_UINT_ARG(1, offset);
+  BUNCH_PARSE_UINT_ARG(2, length);
+  BUNCH_PARSE_BINARY_ARG(3, pattern);
+  ERL_NIF_TERM return_term;
+
+  ShmexLibResult result = shmex_open_and_mmap(&payload);
+  if (SHMEX_RES_OK != result) {
+    return_term = shmex_make_error_term(env, result);
+    goto exit_fill;
+  }
+
+  result = shmex_fill(&payload, offset, length, pattern.data, pattern.size);
+  if (SHMEX_RES_OK != result) {
+    return_term = shmex_make_error_term(env, result);
+    goto exit_fill;
+  }
+
+  return_term = bunch_make_ok_tuple(env, shmex_make_term(env, &payload));
+exit_fill:
+  shmex_release(&payload);
+  return return_term;
+}
+
+static char *make_path(ErlNifBinary *path_binary) {
+  char *path = enif_alloc(path_binary->size + 1);
+  memcpy(path, path_binary->data, path_binary->size);
+  path[path_binary->size] = '\0';
+  return path;
+}
+
+static ERL_NIF_TERM export_read_from_file(ErlNifEnv *env, int argc,
+                                          const ERL_NIF_TERM argv[]) {
+  BUNCH_UNUSED(argc);
+  PARSE_SHMEX_ARG(0, payload);
+  BUNCH_PARSE_BINARY_ARG(1, path_binary);
+  BUNCH_PARSE_ARG(2, file_offset, ErlNifUInt64 file_offset, enif_get_uint64,
+                  &file_offset);
+  BUNCH_PARSE_ARG(3, length, ErlNifSInt64 length, enif_get_int64, &length);
+  ERL_NIF_TERM return_term;
+  ShmexLibResult result;
+  char *path = NULL;
+  int fd = -1;
+
+  if (payload.frozen) {
+    return_term = shmex_make_error_term(env, SHMEX_ERROR_FROZEN);
+    goto exit_read_from_file;
+  }
+
+  path = make_path(&path_binary);
+  SHMEX_TRACE(open_entry, path, 0);
+  fd = open(path, O_RDONLY);
+  SHMEX_TRACE(open_return, path, 0, fd);
+  if (fd < 0) {
+    return_term = bunch_make_error_errno(env, "open");
+    goto exit_read_from_file;
+  }
+
+  // the length is limited to the rest of the file, so that the capacity
+  // is not increased more than needed
+  struct stat file_stat;
+  SHMEX_TRACE(fstat_entry, path, 0);
+  int stat_res = fstat(fd, &file_stat);
+  SHMEX_TRACE(fstat_return, path, 0, stat_res);
+  if (stat_res < 0) {
+    return_term = bunch_make_error_errno(env, "fstat");
+    goto exit_read_from_file;
+  }
+  ErlNifSInt64 file_rest = (ErlNifUInt64)file_stat.st_size > file_offset
+                               ? file_stat.st_size - (ErlNifSInt64)file_offset
+                               : 0;
+  if (length < 0 || length > file_rest) {
+    length = file_rest;
+  }
+
+  if (length > UINT_MAX) {
+    return_term = bunch_make_error_str(env, "invalid_length");
+    goto exit_read_from_file;
+  }
+
+  if (payload.capacity < length) {
+    result = shmex_set_capacity_guarded(env, SHMEX_GUARD_RESOURCE_TYPE,
+                                        &payload, length);
+    if (SHMEX_RES_OK != result) {
+      return_term = shmex_make_error_term(env, result);
+      goto exit_read_from_file;
+    }
+  }
+
+  size_t read_total = 0;
+  if (length > 0) {
+    result = shmex_open_and_mmap(&payload);
+    if (SHMEX_RES_OK != result) {
+      return_term = shmex_make_error_term(env, result);
+      goto exit_read_from_file;
+    }
+
+    while (read_total < (size_t)length) {
+      SHMEX_TRACE(pread_entry, payload.name, length - read_total);
+      ssize_t res = pread(fd, (char *)payload.mapped_memory + read_total,
+                          length - read_total, file_offset + read_total);
+      SHMEX_TRACE(pread_return, payload.name, length - read_total, res);
+      if (res < 0 && errno == EINTR) {
+        continue;
+      }
+      if (res < 0) {
+        return_term = bunch_make_error_errno(env, "pread");
+        goto exit_read_from_file;
+      }
+      if (res == 0) {
+        break;
+      }
+      read_total += res;
+    }
+  }
+
+  payload.size = read_total;
+  return_term = bunch_make_ok_tuple(env, shmex_make_term(env, &payload));
+exit_read_from_file:
+  if (fd >= 0) {
+    close(fd);
+  }
+  if (path != NULL) {
+    enif_free(path);
+  }
+  shmex_release(&payload);
+  notify_usage(env);
+  return return_term;
+}
+
+static ERL_NIF_TERM export_write_to_file(ErlNifEnv *env, int argc,
+                                         const ERL_NIF_TERM argv[]) {
+  BUNCH_UNUSED(argc);
+  PARSE_SHMEX_ARG(0, payload);
+  BUNCH_PARSE_BINARY_ARG(1, path_binary);
+  BUNCH_PARSE_ARG(2, file_offset, ErlNifSInt64 file_offset, enif_get_int64,
+                  &file_offset);
+  BUNCH_PARSE_UINT_ARG(3, source_offset);
+  BUNCH_PARSE_INT_ARG(4, length);
+  ERL_NIF_TERM return_term;
+  ShmexLibResult result;
+  char *path = NULL;
+  int fd = -1;
+
+  // negative length means until the end of the data
+  if (source_offset > payload.size ||
+      (length >= 0 && (unsigned)length > payload.size - source_offset)) {
+    return_term = shmex_make_error_term(env, SHMEX_ERROR_INVALID_RANGE);
+    goto exit_write_to_file;
+  }
+  size_t write_size =
+      length < 0 ? payload.size - source_offset : (size_t)length;
+
+  // negative offset means that the file should be truncated
+  int flags = O_WRONLY | O_CREAT;
+  if (file_offset < 0) {
+    flags |= O_TRUNC;
+    file_offset = 0;
+  }
+
+  path = make_path(&path_binary);
+  SHMEX_TRACE(open_entry, path, 0);
+  fd = open(path, flags, 0666);
+  SHMEX_TRACE(open_return, path, 0, fd);
+  if (fd < 0) {
+    return_term = bunch_make_error_errno(env, "open");
+    goto exit_write_to_file;
+  }
+
+  if (write_size > 0) {
+    result = shmex_open_and_mmap_readonly(&payload);
+    if (SHMEX_RES_OK != result) {
+      return_term = shmex_make_error_term(env, result);
+      goto exit_write_to_file;
+    }
+  }
+
+  char *source = (char *)payload.mapped_memory + source_offset;
+  size_t written_total = 0;
+  while (written_total < write_size) {
+    SHMEX_TRACE(pwrite_entry, payload.name, write_size - written_total);
+    ssize_t res = pwrite(fd, source + written_total, write_size - written_total,
+                         file_offset + written_total);
+    SHMEX_TRACE(pwrite_return, payload.name, write_size - written_total, res);
+    if (res < 0 && errno == EINTR) {
+      continue;
+    }
+    if (res < 0) {
+      return_term = bunch_make_error_errno(env, "pwrite");
+      goto exit_write_to_file;
+    }
+    written_total += res;
+  }
+
+  return_term = bunch_make_ok(env);
+exit_write_to_file:
+  if (fd >= 0) {
+    close(fd);
+  }
+  if (path != NULL) {
+    enif_free(path);
+  }
+  shmex_release(&payload);
+  return return_term;
+}
+
+/**
+ * Receives up to `count` datagrams into consecutive slots of `slot_size`
+ * bytes. Stores the received length of each datagram in `lengths` and sets
+ * `truncated` if it did not fit in its slot. Returns the number of received
+ * datagrams or -1 with errno set if none was received. `name` is used only
+ * for tracing.
+ */
+static int socket_recv_batch(const char *name, int fd, char *memory,
+                             size_t slot_size, unsigned count,
+                             unsigned *lengths, int *truncated) {
+#ifdef __linux__
+  struct mmsghdr *msgs = enif_alloc(count * sizeof(*msgs));
+  struct iovec *iovecs = enif_alloc(count * sizeof(*iovecs));
+  memset(msgs, 0, count * sizeof(*msgs));
+  for (unsigned i = 0; i < count; i++) {
+    iovecs[i].iov_base = memory + i * slot_size;
+    iovecs[i].iov_len = slot_size;
+    msgs[i].msg_hdr.msg_iov = &iovecs[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  SHMEX_TRACE(recvmmsg_entry, name, slot_size * count);
+  int received = recvmmsg(fd, msgs, count, MSG_DONTWAIT, NULL);
+  SHMEX_TRACE(recvmmsg_return, name, slot_size * count, received);
+  for (int i = 0; i < received; i++) {
+    lengths[i] = msgs[i].msg_len;
+    truncated[i] = (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) != 0;
+  }
+
+  enif_free(iovecs);
+  enif_free(msgs);
+  return received;
+#else
+  unsigned received = 0;
+  while (received < count) {
+    struct iovec iovec = {.iov_base = memory + received * slot_size,
+                          .iov_len = slot_size};
+    struct msghdr msg = {.msg_iov = &iovec, .msg_iovlen = 1};
+    SHMEX_TRACE(recv_entry, name, slot_size);
+    ssize_t res = recvmsg(fd, &msg, MSG_DONTWAIT);
+    SHMEX_TRACE(recv_return, name, slot_size, res);
+    if (res < 0) {
+      return received > 0 ? (int)received : -1;
+    }
+    truncated[received] = (msg.msg_flags & MSG_TRUNC) != 0;
+    lengths[received++] = res;
+  }
+  return received;
+#endif
+}
+
+/**
+ * Sends `count` datagrams, the i-th one consisting of `lengths[i]` bytes
+ * starting at `memory + offsets[i]`. Returns the number of sent datagrams
+ * or -1 with errno set if none was sent. `name` is used only for tracing.
+ */
+static int socket_send_batch(const char *name, int fd, char *memory,
+                             unsigned count, unsigned *offsets,
+                             unsigned *lengths) {
+#ifdef __linux__
+  struct mmsghdr *msgs = enif_alloc(count * sizeof(*msgs));
+  struct iovec *iovecs = enif_alloc(count * sizeof(*iovecs));
+  memset(msgs, 0, count * sizeof(*msgs));
+  size_t total_length = 0;
+  for (unsigned i = 0; i < count; i++) {
+    iovecs[i].iov_base = memory + offsets[i];
+    iovecs[i].iov_len = lengths[i];
+    msgs[i].msg_hdr.msg_iov = &iovecs[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+    total_length += lengths[i];
+  }
+
+  SHMEX_TRACE(sendmmsg_entry, name, total_length);
+  int sent = sendmmsg(fd, msgs, count, MSG_DONTWAIT);
+  SHMEX_TRACE(sendmmsg_return, name, total_length, sent);
+
+  enif_free(iovecs);
+  enif_free(msgs);
+  return sent;
+#else
+  unsigned sent = 0;
+  while (sent < count) {
+    SHMEX_TRACE(send_entry, name, lengths[sent]);
+    ssize_t res =
+        send(fd, memory + offsets[sent], lengths[sent], MSG_DONTWAIT);
+    SHMEX_TRACE(send_return, name, lengths[sent], res);
+    if (res < 0) {
+      return sent > 0 ? (int)sent : -1;
+    }
+    sent++;
+  }
+  return sent;
+#endif
+}
+
+static ERL_NIF_TERM export_socket_recv(ErlNifEnv *env, int argc,
+                                       const ERL_NIF_TERM argv[]) {
+  BUNCH_UNUSED(argc);
+  PARSE_SHMEX_ARG(0, payload);
+  BUNCH_PARSE_INT_ARG(1, fd);
+  BUNCH_PARSE_UINT_ARG(2, offset);
+  ERL_NIF_TERM return_term;
+
+  if (payload.frozen) {
+    return_term = shmex_make_error_term(env, SHMEX_ERROR_FROZEN);
+    goto exit_socket_recv;
+  }
+
+  if (offset >= payload.capacity) {
+    return_term = bunch_make_error_str(env, "invalid_range");
+    goto exit_socket_recv;
+  }
+
+  ShmexLibResult result = shmex_open_and_mmap(&payload);
+  if (SHMEX_RES_OK != result) {
+    return_term = shmex_make_error_term(env, result);
+    goto exit_socket_recv;
+  }
+
+  SHMEX_TRACE(recv_entry, payload.name, payload.capacity - offset);
+  ssize_t res = recv(fd, (char *)payload.mapped_memory + offset,
+                     payload.capacity - offset, MSG_DONTWAIT);
+  SHMEX_TRACE(recv_return, payload.name, payload.capacity - offset, res);
+  if (res < 0) {
+    return_term = bunch_make_error_errno(env, "recv");
+    goto exit_socket_recv;
+  }
+
+  payload.size = offset + res;
+  return_term = bunch_make_ok_tuple(env, shmex_make_term(env, &payload));
+exit_socket_recv:
+  shmex_release(&payload);
+  return return_term;
+}
+
+static ERL_NIF_TERM export_socket_recv_batch(ErlNifEnv *env, int argc,
+                                             const ERL_NIF_TERM argv[]) {
+  BUNCH_UNUSED(argc);
+  PARSE_SHMEX_ARG(0, payload);
+  BUNCH_PARSE_INT_ARG(1, fd);
+  BUNCH_PARSE_UINT_ARG(2, slot_size);
+  BUNCH_PARSE_UINT_ARG(3, count);
+  ERL_NIF_TERM return_term;
+  unsigned *lengths = NULL;
+  int *truncated = NULL;
+
+  if (payload.frozen) {
+    return_term = shmex_make_error_term(env, SHMEX_ERROR_FROZEN);
+    goto exit_socket_recv_batch;
+  }
+
+  if (count == 0 || count > SOCKET_BATCH_MAX || slot_size == 0 ||
+      (size_t)slot_size * count > payload.capacity) {
+    return_term = bunch_make_error_str(env, "invalid_range");
+    goto exit_socket_recv_batch;
+  }
+
+  ShmexLibResult result = shmex_open_and_mmap(&payload);
+  if (SHMEX_RES_OK != result) {
+    return_term = shmex_make_error_term(env, result);
+    goto exit_socket_recv_batch;
+  }
+
+  lengths = enif_alloc(count * sizeof(*lengths));
+  truncated = enif_alloc(count * sizeof(*truncated));
+  int received = socket_recv_batch(payload.name, fd, payload.mapped_memory,
+                                   slot_size, count, lengths, truncated);
+  if (received < 0) {
+    return_term = bunch_make_error_errno(env, "recv");
+    goto exit_socket_recv_batch;
+  }
+
+  ERL_NIF_TERM datagrams_term = enif_make_list(env, 0);
+  for (int i = received - 1; i >= 0; i--) {
+    ERL_NIF_TERM datagram_term = enif_make_tuple2(
+        env, enif_make_uint(env, lengths[i]),
+        enif_make_atom(env, truncated[i] ? "true" : "false"));
+    datagrams_term = enif_make_list_cell(env, datagram_term, datagrams_term);
+  }
+
+  payload.size = (received - 1) * slot_size + lengths[received - 1];
+  return_term = bunch_make_ok_tuple(
+      env,
+      enif_make_tuple2(env, shmex_make_term(env, &payload), datagrams_term));
+exit_socket_recv_batch:
+  if (lengths != NULL) {
+    enif_free(lengths);
+  }
+  if (truncated != NULL) {
+    enif_free(truncated);
+  }
+  shmex_release(&payload);
+  return return_term;
+}
+
+static ERL_NIF_TERM export_socket_send(ErlNifEnv *env, int argc,
+                                       const ERL_NIF_TERM argv[]) {
+  BUNCH_UNUSED(argc);
+  PARSE_SHMEX_ARG(0, payload);
+  BUNCH_PARSE_INT_ARG(1, fd);
+  BUNCH_PARSE_UINT_ARG(2, offset);
+  BUNCH_PARSE_UINT_ARG(3, length);
+  ERL_NIF_TERM return_term;
+
+  if ((size_t)offset + length > payload.size) {
+    return_term = bunch_make_error_str(env, "invalid_range");
+    goto exit_socket_send;
+  }
+
+  ShmexLibResult result = shmex_open_and_mmap_readonly(&payload);
+  if (SHMEX_RES_OK != result) {
+    return_term = shmex_make_error_term(env, result);
+    goto exit_socket_send;
+  }
+
+  SHMEX_TRACE(send_entry, payload.name, length);
+  ssize_t res = send(fd, (char *)payload.mapped_memory + offset, length,
+                     MSG_DONTWAIT);
+  SHMEX_TRACE(send_return, payload.name, length, res);
+  if (res < 0) {
+    return_term = bunch_make_error_errno(env, "send");
+    goto exit_socket_send;
+  }
+
+  return_term = bunch_make_ok_tuple(env, enif_make_uint(env, res));
+exit_socket_send:
+  shmex_release(&payload);
+  return return_term;
+}
+
+static ERL_NIF_TERM export_socket_send_batch(ErlNifEnv *env, int argc,
+                                             const ERL_NIF_TERM argv[]) {
+  BUNCH_UNUSED(argc);
+  PARSE_SHMEX_ARG(0, payload);
+  BUNCH_PARSE_INT_ARG(1, fd);
+  ERL_NIF_TERM return_term;
+  unsigned *offsets = NULL;
+  unsigned *lengths = NULL;
+
+  unsigned count;
+  if (!enif_get_list_length(env, argv[2], &count) || count == 0 ||
+      count > SOCKET_BATCH_MAX) {
+    return_term = bunch_make_error_str(env, "invalid_range");
+    goto exit_socket_send_batch;
+  }
+
+  offsets = enif_alloc(count * sizeof(*offsets));
+  lengths = enif_alloc(count * sizeof(*lengths));
+  ERL_NIF_TERM list = argv[2], head;
+  for (unsigned i = 0; enif_get_list_cell(env, list, &head, &list); i++) {
+    int arity;
+    const ERL_NIF_TERM *range;
+    if (!enif_get_tuple(env, head, &arity, &range) || arity != 2 ||
+        !enif_get_uint(env, range[0], &offsets[i]) ||
+        !enif_get_uint(env, range[1], &lengths[i]) ||
+        (size_t)offsets[i] + lengths[i] > payload.size) {
+      return_term = bunch_make_error_str(env, "invalid_range");
+      goto exit_socket_send_batch;
+    }
+  }
+
+  ShmexLibResult result = shmex_open_and_mmap_readonly(&payload);
+  if (SHMEX_RES_OK != result) {
+    return_term = shmex_make_error_term(env, result);
+    goto exit_socket_send_batch;
+  }
+
+  int sent = socket_send_batch(payload.name, fd, payload.mapped_memory, count,
+                               offsets, lengths);
+  if (sent < 0) {
+    return_term = bunch_make_error_errno(env, "send");
+    goto exit_socket_send_batch;
+  }
+
+  return_term = bunch_make_ok_tuple(env, enif_make_int(env, sent));
+exit_socket_send_batch:
+  if (offsets != NULL) {
+    enif_free(offsets);
+  }
+  if (lengths != NULL) {
+    enif_free(lengths);
+  }
+  shmex_release(&payload);
+  return return_term;
+}
+
+static ERL_NIF_TERM export_freeze(ErlNifEnv *env, int argc,
+                                  const ERL_NIF_TERM argv[]) {
+  BUNCH_UNUSED(argc);
+  PARSE_SHMEX_ARG(0, payload);
+  ERL_NIF_TERM return_term;
+
+  ShmexLibResult result = shmex_freeze(&payload);
+  if (SHMEX_RES_OK == result) {
+    return_term = bunch_make_ok_tuple(env, shmex_make_term(env, &payload));
+  } else {
+    return_term = shmex_make_error_term(env, result);
+  }
+  shmex_release(&payload);
+  return return_term;
+}
+
 static ERL_NIF_TERM export_ensure_not_gc(ErlNifEnv *env, int argc,
                                          const ERL_NIF_TERM argv[]) {
   BUNCH_UNUSED(argc);
@@ -213,7 +879,8 @@ static ERL_NIF_TERM export_append(ErlNifEnv *env, int argc,
   ShmexLibResult result;
 
   size_t new_capacity = left.size + right.size;
-  result = shmex_set_capacity(&left, new_capacity);
+  result = shmex_set_capacity_guarded(env, SHMEX_GUARD_RESOURCE_TYPE, &left,
+                                      new_capacity);
   if (SHMEX_RES_OK != result) {
     return_term = shmex_make_error_term(env, result);
     goto exit_append;
@@ -225,21 +892,215 @@ static ERL_NIF_TERM export_append(ErlNifEnv *env, int argc,
     goto exit_append;
   }
 
-  result = shmex_open_and_mmap(&right);
+  result = shmex_open_and_mmap_readonly(&right);
   if (SHMEX_RES_OK != result) {
     return_term = shmex_make_error_term(env, result);
     goto exit_append;
   }
 
+  SHMEX_TRACE(copy_entry, left.name, right.size);
   memcpy(left.mapped_memory + left.size, right.mapped_memory, right.size);
+  SHMEX_TRACE(copy_return, left.name, right.size, 0);
   left.size = new_capacity;
   return_term = bunch_make_ok_tuple(env, shmex_make_term(env, &left));
 exit_append:
   shmex_release(&left);
   shmex_release(&right);
+  notify_usage(env);
   return return_term;
 }
 
+static ERL_NIF_TERM export_set_numa_policy(ErlNifEnv *env, int argc,
+                                           const ERL_NIF_TERM argv[]) {
+  BUNCH_UNUSED(argc);
+  PARSE_SHMEX_ARG(0, payload);
+  BUNCH_PARSE_UINT_ARG(1, policy);
+  BUNCH_PARSE_INT_ARG(2, node);
+  ERL_NIF_TERM return_term;
+
+  if (policy > SHMEX_NUMA_INTERLEAVE) {
+    return_term = bunch_make_error_str(env, "invalid_numa_policy");
+    goto exit_set_numa_policy;
+  }
+
+  ShmexLibResult result =
+      shmex_set_numa_policy(&payload, (ShmexNumaPolicy)policy, node);
+  if (SHMEX_RES_OK == result) {
+    return_term = bunch_make_ok(env);
+  } else {
+    return_term = shmex_make_error_term(env, result);
+  }
+exit_set_numa_policy:
+  shmex_release(&payload);
+  return return_term;
+}
+
+static ERL_NIF_TERM export_numa_node(ErlNifEnv *env, int argc,
+                                     const ERL_NIF_TERM argv[]) {
+  BUNCH_UNUSED(argc);
+  PARSE_SHMEX_ARG(0, payload);
+  ERL_NIF_TERM return_term;
+
+  int node;
+  ShmexLibResult result = shmex_get_numa_node(&payload, &node);
+  if (SHMEX_RES_OK == result) {
+    return_term = bunch_make_ok_tuple(env, enif_make_int(env, node));
+  } else {
+    return_term = shmex_make_error_term(env, result);
+  }
+  shmex_release(&payload);
+  return return_term;
+}
+
+static ERL_NIF_TERM export_slab_create(ErlNifEnv *env, int argc,
+                                       const ERL_NIF_TERM argv[]) {
+  BUNCH_UNUSED(argc);
+  BUNCH_PARSE_UINT_ARG(0, chunk_size);
+  BUNCH_PARSE_UINT_ARG(1, chunk_count);
+
+  size_t aligned_chunk_size =
+      ((size_t)chunk_size + SHMEX_SLAB_CHUNK_ALIGN - 1) /
+      SHMEX_SLAB_CHUNK_ALIGN * SHMEX_SLAB_CHUNK_ALIGN;
+  if (chunk_size == 0 || chunk_count == 0 ||
+      sysconf(_SC_PAGESIZE) + aligned_chunk_size * chunk_count > UINT_MAX) {
+    return bunch_make_error_str(env, "invalid_slab_size");
+  }
+
+  ERL_NIF_TERM slab_term;
+  ShmexLibResult result =
+      shmex_slab_create(env, SHMEX_SLAB_RESOURCE_TYPE, chunk_size, chunk_count,
+                        &slab_term);
+  notify_usage(env);
+  if (SHMEX_RES_OK != result) {
+    return shmex_make_error_term(env, result);
+  }
+  return bunch_make_ok_tuple(env, slab_term);
+}
+
+static ERL_NIF_TERM export_slab_allocate(ErlNifEnv *env, int argc,
+                                         const ERL_NIF_TERM argv[]) {
+  BUNCH_UNUSED(argc);
+  BUNCH_PARSE_ARG(0, slab, ShmexSlab *slab, enif_get_resource,
+                  SHMEX_SLAB_RESOURCE_TYPE, (void **)&slab);
+
+  Shmex payload;
+  shmex_init(env, &payload, 0);
+  ERL_NIF_TERM return_term;
+
+  ShmexLibResult result = shmex_slab_allocate(
+      env, SHMEX_SLAB_CHUNK_GUARD_RESOURCE_TYPE, slab, &payload);
+  if (SHMEX_RES_OK == result) {
+    return_term = bunch_make_ok_tuple(env, shmex_make_term(env, &payload));
+  } else {
+    return_term = shmex_make_error_term(env, result);
+  }
+  shmex_release(&payload);
+  return return_term;
+}
+
+static ERL_NIF_TERM export_set_budget(ErlNifEnv *env, int argc,
+                                      const ERL_NIF_TERM argv[]) {
+  BUNCH_UNUSED(argc);
+  BUNCH_PARSE_ARG(0, budget, ErlNifUInt64 budget, enif_get_uint64, &budget);
+  shmex_set_budget(budget);
+  return bunch_make_ok(env);
+}
+
+static ERL_NIF_TERM export_usage(ErlNifEnv *env, int argc,
+                                 const ERL_NIF_TERM argv[]) {
+  BUNCH_UNUSED(argc);
+  BUNCH_UNUSED(argv);
+  return bunch_make_ok_tuple(
+      env, enif_make_tuple2(env, enif_make_uint64(env, shmex_get_usage()),
+                            enif_make_uint64(env, shmex_get_budget())));
+}
+
+static ERL_NIF_TERM export_subscribe_usage(ErlNifEnv *env, int argc,
+                                           const ERL_NIF_TERM argv[]) {
+  BUNCH_UNUSED(argc);
+  BUNCH_PARSE_ARG(0, watermark, ErlNifUInt64 watermark, enif_get_uint64,
+                  &watermark);
+  ERL_NIF_TERM return_term;
+
+  enif_mutex_lock(usage_subscriptions_lock);
+  // make room by removing subscriptions of dead processes
+  for (unsigned i = 0; usage_subscriptions_count == USAGE_SUBSCRIPTIONS_MAX &&
+                       i < usage_subscriptions_count;) {
+    if (enif_is_process_alive(env, &usage_subscriptions[i].pid)) {
+      i++;
+    } else {
+      remove_subscription(i);
+    }
+  }
+
+  if (usage_subscriptions_count == USAGE_SUBSCRIPTIONS_MAX) {
+    return_term = bunch_make_error_str(env, "too_many_subscriptions");
+  } else {
+    UsageSubscription *subscription =
+        &usage_subscriptions[usage_subscriptions_count];
+    enif_self(env, &subscription->pid);
+    subscription->watermark = watermark;
+    subscription->above = shmex_get_usage() >= watermark;
+    __atomic_store_n(&usage_subscriptions_count, usage_subscriptions_count + 1,
+                     __ATOMIC_RELAXED);
+    return_term = bunch_make_ok_tuple(
+        env, enif_make_atom(env, subscription->above ? "above" : "below"));
+  }
+  enif_mutex_unlock(usage_subscriptions_lock);
+  return return_term;
+}
+
+static ERL_NIF_TERM export_unsubscribe_usage(ErlNifEnv *env, int argc,
+                                             const ERL_NIF_TERM argv[]) {
+  BUNCH_UNUSED(argc);
+  BUNCH_UNUSED(argv);
+  ErlNifPid self;
+  enif_self(env, &self);
+
+  enif_mutex_lock(usage_subscriptions_lock);
+  remove_subscriptions_of(&self);
+  enif_mutex_unlock(usage_subscriptions_lock);
+  return bunch_make_ok(env);
+}
+
+static ERL_NIF_TERM export_alloc_stats(ErlNifEnv *env, int argc,
+                                       const ERL_NIF_TERM argv[]) {
+  BUNCH_UNUSED(argc);
+  BUNCH_UNUSED(argv);
+  ShmexAllocStats stats;
+  shmex_get_alloc_stats(&stats);
+
+  ERL_NIF_TERM keys[] = {enif_make_atom(env, "allocations"),
+                         enif_make_atom(env, "failures"),
+                         enif_make_atom(env, "name_retries"),
+                         enif_make_atom(env, "shm_open_ns"),
+                         enif_make_atom(env, "ftruncate_ns"),
+                         enif_make_atom(env, "unlinks"),
+                         enif_make_atom(env, "unlink_wait_ns"),
+                         enif_make_atom(env, "unlink_ns")};
+  ERL_NIF_TERM values[] = {enif_make_uint64(env, stats.allocations),
+                           enif_make_uint64(env, stats.failures),
+                           enif_make_uint64(env, stats.name_retries),
+                           enif_make_uint64(env, stats.shm_open_ns),
+                           enif_make_uint64(env, stats.ftruncate_ns),
+                           enif_make_uint64(env, stats.unlinks),
+                           enif_make_uint64(env, stats.unlink_wait_ns),
+                           enif_make_uint64(env, stats.unlink_ns)};
+
+  ERL_NIF_TERM stats_term;
+  enif_make_map_from_arrays(env, keys, values, sizeof(keys) / sizeof(*keys),
+                            &stats_term);
+  return bunch_make_ok_tuple(env, stats_term);
+}
+
+static ERL_NIF_TERM export_reset_alloc_stats(ErlNifEnv *env, int argc,
+                                             const ERL_NIF_TERM argv[]) {
+  BUNCH_UNUSED(argc);
+  BUNCH_UNUSED(argv);
+  shmex_reset_alloc_stats();
+  return bunch_make_ok(env);
+}
+
 static ErlNifFunc nif_funcs[] = {{"allocate", 1, export_allocate, 0},
                                  {"add_guard", 1, export_add_guard, 0},
                                  {"set_capacity", 2, export_set_capacity, 0},
@@ -248,6 +1109,35 @@ static ErlNifFunc nif_funcs[] = {{"allocate", 1, export_allocate, 0},
                                  {"split_at", 2, export_split_at, 0},
                                  {"append", 2, export_append, 0},
                                  {"trim_leading", 2, export_trim_leading, 0},
-                                 {"ensure_not_gc", 1, export_ensure_not_gc, 0}};
+                                 {"fill_pattern", 4, export_fill,
+                                  ERL_NIF_DIRTY_JOB_CPU_BOUND},
+                                 {"freeze", 1, export_freeze, 0},
+                                 {"socket_recv", 3, export_socket_recv, 0},
+                                 {"socket_recv_batch", 4,
+                                  export_socket_recv_batch,
+                                  ERL_NIF_DIRTY_JOB_IO_BOUND},
+                                 {"socket_send", 4, export_socket_send, 0},
+                                 {"socket_send_batch", 3,
+                                  export_socket_send_batch, 0},
+                                 {"read_from_file", 4, export_read_from_file,
+                                  ERL_NIF_DIRTY_JOB_IO_BOUND},
+                                 {"write_to_file", 5, export_write_to_file,
+                                  ERL_NIF_DIRTY_JOB_IO_BOUND},
+                                 {"ensure_not_gc", 1, export_ensure_not_gc, 0},
+                                 {"set_numa_policy", 3,
+                                  export_set_numa_policy,
+                                  ERL_NIF_DIRTY_JOB_CPU_BOUND},
+                                 {"numa_node", 1, export_numa_node, 0},
+                                 {"slab_create", 2, export_slab_create, 0},
+                                 {"slab_allocate", 1, export_slab_allocate, 0},
+                                 {"set_budget_bytes", 1, export_set_budget, 0},
+                                 {"get_usage", 0, export_usage, 0},
+                                 {"subscribe_usage", 1, export_subscribe_usage,
+                                  0},
+                                 {"unsubscribe_usage", 0,
+                                  export_unsubscribe_usage, 0},
+                                 {"alloc_stats", 0, export_alloc_stats, 0},
+                                 {"reset_alloc_stats", 0,
+                                  export_reset_alloc_stats, 0}};
 
 ERL_NIF_INIT(Elixir.Shmex.Native.Nif, nif_funcs, load, NULL, NULL, NULL)
@@ -1,4 +1,5 @@
-// feature test macro for clock_gettime and ftruncate
+// feature test macros for clock_gettime, ftruncate and Linux-specific syscalls
+#define _GNU_SOURCE
 #define _POSIX_C_SOURCE 200809L
 
 #include <errno.h>
@@ -8,8 +9,12 @@
 #include <sys/stat.h>
 #include <time.h>
 #include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
 
 #include "lib.h"
+#include "trace.h"
 
 #ifdef SHMEX_NIF
 #define ALLOC(X) enif_alloc(X)
@@ -19,6 +24,64 @@
 #define FREE(X) free(X)
 #endif
 
+#define STAT_ADD(FIELD, VALUE)                                                 \
+  __atomic_fetch_add(&alloc_stats.FIELD, (VALUE), __ATOMIC_RELAXED)
+
+static ShmexAllocStats alloc_stats;
+static uint64_t usage;
+static uint64_t budget;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * Adds `bytes` to the usage, unless it would exceed the budget.
+ * Returns 0 on success.
+ */
+static int reserve_usage(uint64_t bytes) {
+  uint64_t current = __atomic_load_n(&usage, __ATOMIC_RELAXED);
+  uint64_t limit = __atomic_load_n(&budget, __ATOMIC_RELAXED);
+  do {
+    if (limit > 0 && current + bytes > limit) {
+      return 1;
+    }
+  } while (!__atomic_compare_exchange_n(&usage, &current, current + bytes, 1,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+  return 0;
+}
+
+static void release_usage(uint64_t bytes) {
+  uint64_t current = __atomic_load_n(&usage, __ATOMIC_RELAXED);
+  uint64_t released;
+  do {
+    released = current > bytes ? current - bytes : 0;
+  } while (!__atomic_compare_exchange_n(&usage, &current, released, 1,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+/**
+ * Sets `*accounted_size` to `capacity` and adjusts the usage by the change,
+ * taking into account `reserved` bytes that were already added to it.
+ * The exchange is atomic, so concurrent resizes of the same segment leave
+ * the usage consistent with the last stored size.
+ */
+static void account_capacity(uint64_t *accounted_size, uint64_t capacity,
+                             uint64_t reserved) {
+  uint64_t previous =
+      __atomic_exchange_n(accounted_size, capacity, __ATOMIC_RELAXED);
+  if (capacity >= previous + reserved) {
+    // growth not covered by the reservation is added even above the budget,
+    // as the segment already has the new size
+    __atomic_fetch_add(&usage, capacity - previous - reserved,
+                       __ATOMIC_RELAXED);
+  } else {
+    release_usage(previous + reserved - capacity);
+  }
+}
+
 void shmex_generate_shm_name(char *name, int attempt) {
   struct timespec ts;
   clock_gettime(CLOCK_MONOTONIC, &ts);
@@ -34,6 +97,10 @@ void shmex_generate_shm_name(char *name, int attempt) {
  * the one that haven't been used is found (at most SHMEX_ALLOC_MAX_ATTEMPTS
  * times).
  *
+ * The capacity is added to the usage of shared memory, which fails with
+ * `SHMEX_ERROR_BUDGET_EXCEEDED` if the budget set with 'shmex_set_budget'
+ * would be exceeded. The usage is decreased by 'shmex_unlink_accounted'.
+ *
  * Shared memory can be accessed by using 'shmex_open_and_mmap'.
  * Memory will be unmapped when Shmex struct is freed (by 'shmex_release')
  */
@@ -41,26 +108,43 @@ ShmexLibResult shmex_allocate_unguarded(Shmex *payload) {
   ShmexLibResult result;
   int fd = -1;
 
+  if (reserve_usage(payload->capacity)) {
+    STAT_ADD(failures, 1);
+    return SHMEX_ERROR_BUDGET_EXCEEDED;
+  }
+
   static const int open_flags = O_RDWR | O_CREAT | O_EXCL;
   static const int open_privileges = 0666;
+  uint64_t start_ns = now_ns();
   if (payload->name != NULL) {
+    SHMEX_TRACE(shm_open_entry, payload->name, payload->capacity);
     fd = shm_open(payload->name, open_flags, open_privileges);
+    SHMEX_TRACE(shm_open_return, payload->name, payload->capacity, fd);
   } else {
     payload->name = ALLOC(SHMEX_SHM_NAME_LEN);
     int attempt = 0;
     do {
       shmex_generate_shm_name(payload->name, attempt);
+      // each attempt is traced, so that retries on name conflicts are visible
+      SHMEX_TRACE(shm_open_entry, payload->name, payload->capacity);
       fd = shm_open(payload->name, open_flags, open_privileges);
+      SHMEX_TRACE(shm_open_return, payload->name, payload->capacity, fd);
       attempt++;
     } while (fd < 0 && (errno == EEXIST || errno == EAGAIN) &&
              attempt < SHMEX_ALLOC_MAX_ATTEMPTS);
+    STAT_ADD(name_retries, attempt - 1);
   }
+  uint64_t open_end_ns = now_ns();
+  STAT_ADD(shm_open_ns, open_end_ns - start_ns);
   if (fd < 0) {
     result = SHMEX_ERROR_SHM_OPEN;
     goto shmex_create_exit;
   }
 
+  SHMEX_TRACE(ftruncate_entry, payload->name, payload->capacity);
   int ftr_res = ftruncate(fd, payload->capacity);
+  STAT_ADD(ftruncate_ns, now_ns() - open_end_ns);
+  SHMEX_TRACE(ftruncate_return, payload->name, payload->capacity, ftr_res);
   if (ftr_res < 0) {
     result = SHMEX_ERROR_FTRUNCATE;
     goto shmex_create_exit;
@@ -72,9 +156,105 @@ shmex_create_exit:
     close(fd);
   }
   if (SHMEX_RES_OK != result) {
+    STAT_ADD(failures, 1);
+    release_usage(payload->capacity);
     if (fd > 0) {
       shm_unlink(payload->name);
     }
+  } else {
+    STAT_ADD(allocations, 1);
+  }
+  return result;
+}
+
+/**
+ * Returns the distance between the start of payload's memory and the page
+ * boundary preceding it. It is non-zero only for slab chunks, as mmap offset
+ * has to be aligned to the page size.
+ */
+static size_t page_offset(Shmex *payload) {
+  return payload->offset % sysconf(_SC_PAGESIZE);
+}
+
+/**
+ * Opens shared memory for writing. Fails with `SHMEX_ERROR_FROZEN` if
+ * the payload or the segment itself was frozen with 'shmex_freeze', so that
+ * stale or modified structs cannot be used to write to a frozen segment, also
+ * when the process is privileged enough to open it for writing anyway.
+ */
+static ShmexLibResult open_writable(Shmex *payload, int *fd) {
+  if (payload->frozen) {
+    return SHMEX_ERROR_FROZEN;
+  }
+
+  SHMEX_TRACE(shm_open_entry, payload->name, payload->capacity);
+  *fd = shm_open(payload->name, O_RDWR, 0666);
+  SHMEX_TRACE(shm_open_return, payload->name, payload->capacity, *fd);
+  if (*fd < 0 && errno != EACCES) {
+    return SHMEX_ERROR_SHM_OPEN;
+  }
+
+  // frozen segments have no write permissions, which is checked also when
+  // opening failed with EACCES, to tell whether it was caused by freezing
+  int stat_fd = *fd >= 0 ? *fd : shm_open(payload->name, O_RDONLY, 0666);
+  struct stat shm_stat;
+  SHMEX_TRACE(fstat_entry, payload->name, payload->capacity);
+  int res = stat_fd >= 0 ? fstat(stat_fd, &shm_stat) : -1;
+  SHMEX_TRACE(fstat_return, payload->name, payload->capacity, res);
+  int frozen = res == 0 && (shm_stat.st_mode & 0222) == 0;
+
+  if (*fd < 0) {
+    if (stat_fd >= 0) {
+      close(stat_fd);
+    }
+    errno = EACCES;
+    return frozen ? SHMEX_ERROR_FROZEN : SHMEX_ERROR_SHM_OPEN;
+  }
+  if (frozen) {
+    close(*fd);
+    *fd = -1;
+    return SHMEX_ERROR_FROZEN;
+  }
+  return SHMEX_RES_OK;
+}
+
+static ShmexLibResult open_and_mmap(Shmex *payload, int writable) {
+  ShmexLibResult result;
+  int fd = -1;
+
+  if (writable) {
+    result = open_writable(payload, &fd);
+    if (SHMEX_RES_OK != result) {
+      goto shmex_open_and_mmap_exit;
+    }
+  } else {
+    SHMEX_TRACE(shm_open_entry, payload->name, payload->capacity);
+    fd = shm_open(payload->name, O_RDONLY, 0666);
+    SHMEX_TRACE(shm_open_return, payload->name, payload->capacity, fd);
+    if (fd < 0) {
+      result = SHMEX_ERROR_SHM_OPEN;
+      goto shmex_open_and_mmap_exit;
+    }
+  }
+
+  int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+  size_t map_offset = page_offset(payload);
+  SHMEX_TRACE(mmap_entry, payload->name, payload->capacity);
+  char *memory = mmap(NULL, payload->capacity + map_offset, prot, MAP_SHARED,
+                      fd, payload->offset - map_offset);
+  SHMEX_TRACE(mmap_return, payload->name, payload->capacity, memory);
+  if (MAP_FAILED == memory) {
+    payload->mapped_memory = MAP_FAILED;
+    result = SHMEX_ERROR_MMAP;
+    goto shmex_open_and_mmap_exit;
+  }
+  payload->mapped_memory = memory + map_offset;
+  payload->mapped_writable = writable;
+
+  result = SHMEX_RES_OK;
+shmex_open_and_mmap_exit:
+  if (fd > 0) {
+    close(fd);
   }
   return result;
 }
@@ -82,73 +262,471 @@ shmex_create_exit:
 /**
  * Maps shared memory into address space of current process (using mmap)
  *
+ * Only the part of shared memory starting at payload->offset is accessible
+ * through the mapping.
+ *
  * On success sets payload->mapped_memory to a valid pointer. On failure it is
  * set to MAP_FAILED ((void *)-1) and returned result indicates which function
  * failed.
  *
+ * Fails with `SHMEX_ERROR_FROZEN` for frozen payloads and segments
+ * (see 'shmex_freeze'), which can be mapped only with
+ * 'shmex_open_and_mmap_readonly'.
+ *
  * Mapped memory has to be released with either 'shmex_release' or
  * 'shmex_unmap'.
  *
- * While memory is mapped the capacity of shm must not be modified.
+ * While memory is mapped the capacity of shm can be modified only with
+ * 'shmex_set_capacity', which keeps the mapping in sync.
  */
 ShmexLibResult shmex_open_and_mmap(Shmex *payload) {
+  return open_and_mmap(payload, 1);
+}
+
+/**
+ * Works like 'shmex_open_and_mmap', but maps shared memory read-only, so
+ * writing to the mapped memory results in a segmentation fault. Works also
+ * for frozen payloads.
+ */
+ShmexLibResult shmex_open_and_mmap_readonly(Shmex *payload) {
+  return open_and_mmap(payload, 0);
+}
+
+/**
+ * Makes shared memory read-only and marks the payload as frozen.
+ *
+ * Permissions of the shared memory object are changed to 0444, so that it
+ * can no longer be opened for writing by unprivileged processes. Shmex
+ * functions refuse to write to the segment, checking its permissions rather
+ * than only the payload's flag, so also other, not frozen copies of
+ * the payload cannot be used to modify it.
+ *
+ * POSIX shared memory cannot be sealed like memfd, so the following is not
+ * prevented:
+ * - writing through mappings created before freezing,
+ * - writing by code not using Shmex running as the segment's owner, which
+ *   can restore the permissions, or with superuser privileges.
+ */
+ShmexLibResult shmex_freeze(Shmex *payload) {
   ShmexLibResult result;
   int fd = -1;
 
-  fd = shm_open(payload->name, O_RDWR, 0666);
+  if (payload->offset != 0) {
+    result = SHMEX_ERROR_SLAB_CHUNK;
+    goto shmex_freeze_exit;
+  }
+
+  SHMEX_TRACE(shm_open_entry, payload->name, payload->capacity);
+  fd = shm_open(payload->name, O_RDONLY, 0666);
+  SHMEX_TRACE(shm_open_return, payload->name, payload->capacity, fd);
   if (fd < 0) {
     result = SHMEX_ERROR_SHM_OPEN;
-    goto shmex_open_and_mmap_exit;
+    goto shmex_freeze_exit;
   }
 
-  payload->mapped_memory =
-      mmap(NULL, payload->capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-  if (MAP_FAILED == payload->mapped_memory) {
-    result = SHMEX_ERROR_MMAP;
-    goto shmex_open_and_mmap_exit;
+  SHMEX_TRACE(fchmod_entry, payload->name, payload->capacity);
+  int res = fchmod(fd, 0444);
+  SHMEX_TRACE(fchmod_return, payload->name, payload->capacity, res);
+  if (res < 0) {
+    result = SHMEX_ERROR_FCHMOD;
+    goto shmex_freeze_exit;
   }
 
+  payload->frozen = 1;
   result = SHMEX_RES_OK;
-shmex_open_and_mmap_exit:
+shmex_freeze_exit:
   if (fd > 0) {
     close(fd);
   }
   return result;
 }
 
+/**
+ * Releases the pages of shared memory between 'start' and 'end', which have
+ * to be page aligned. Subsequent reads of this range return zeros, as in
+ * a freshly allocated segment. Returns 0 on success.
+ */
+static int punch_hole(Shmex *payload, char *start, char *end) {
+#ifdef MADV_REMOVE
+  SHMEX_TRACE(madvise_entry, payload->name, end - start);
+  int res = madvise(start, end - start, MADV_REMOVE);
+  SHMEX_TRACE(madvise_return, payload->name, end - start, res);
+  return res;
+#else
+  (void)payload;
+  (void)start;
+  (void)end;
+  return -1;
+#endif
+}
+
+/**
+ * Zeroes memory from 'start' to 'end'. Whole pages inside large ranges are
+ * released instead of being written, so that they are again backed by the zero
+ * page until touched. Returns the number of released bytes.
+ */
+static size_t fill_zeros(Shmex *payload, char *start, char *end) {
+  size_t page_size = sysconf(_SC_PAGESIZE);
+  char *hole_start =
+      (char *)(((uintptr_t)start + page_size - 1) & ~(page_size - 1));
+  char *hole_end = (char *)((uintptr_t)end & ~(page_size - 1));
+  if (hole_end > hole_start &&
+      (size_t)(hole_end - hole_start) >= SHMEX_FILL_HOLE_MIN_SIZE &&
+      punch_hole(payload, hole_start, hole_end) == 0) {
+    memset(start, 0, hole_start - start);
+    memset(hole_end, 0, end - hole_end);
+    return hole_end - hole_start;
+  }
+  memset(start, 0, end - start);
+  return 0;
+}
+
+/**
+ * Fills 'length' bytes of shared memory starting at 'offset' with repeated
+ * 'pattern' of 'pattern_size' bytes and extends payload->size to the end
+ * of the filled range if needed. If 'offset' exceeds payload->size, the bytes
+ * in between are zeroed, so that no stale content becomes part of the data.
+ *
+ * Payload has to be mapped with 'shmex_open_and_mmap'.
+ *
+ * Single byte patterns are filled with memset, longer ones by copying the
+ * already filled part of the range, doubling it each time. Zeros are filled
+ * with 'fill_zeros'. The fill_return probe receives the number of bytes
+ * released instead of being written.
+ */
+ShmexLibResult shmex_fill(Shmex *payload, size_t offset, size_t length,
+                          const void *pattern, size_t pattern_size) {
+  if (payload->frozen) {
+    return SHMEX_ERROR_FROZEN;
+  }
+
+  if (offset > payload->capacity || length > payload->capacity - offset ||
+      pattern_size == 0) {
+    return SHMEX_ERROR_INVALID_RANGE;
+  }
+
+  SHMEX_TRACE(fill_entry, payload->name, length);
+  char *start = (char *)payload->mapped_memory + offset;
+  char *end = start + length;
+  size_t released = 0;
+
+  if (payload->size < offset) {
+    char *data_end = (char *)payload->mapped_memory + payload->size;
+    released += fill_zeros(payload, data_end, start);
+  }
+
+  if (pattern_size == 1) {
+    unsigned char byte = *(const unsigned char *)pattern;
+    if (byte == 0) {
+      released += fill_zeros(payload, start, end);
+    } else {
+      memset(start, byte, length);
+    }
+  } else {
+    size_t filled = pattern_size < length ? pattern_size : length;
+    memcpy(start, pattern, filled);
+    while (filled < length) {
+      size_t chunk = filled < length - filled ? filled : length - filled;
+      memcpy(start + filled, start, chunk);
+      filled += chunk;
+    }
+  }
+  SHMEX_TRACE(fill_return, payload->name, length, released);
+
+  if (payload->size < offset + length) {
+    payload->size = offset + length;
+  }
+  return SHMEX_RES_OK;
+}
+
 void shmex_unmap(Shmex *payload) {
   if (payload->mapped_memory != MAP_FAILED) {
-    munmap(payload->mapped_memory, payload->capacity);
+    size_t map_offset = page_offset(payload);
+    SHMEX_TRACE(munmap_entry, payload->name, payload->capacity);
+    munmap((char *)payload->mapped_memory - map_offset,
+           payload->capacity + map_offset);
+    SHMEX_TRACE(munmap_return, payload->name, payload->capacity, 0);
   }
   payload->mapped_memory = MAP_FAILED;
 }
 
+#ifdef __linux__
+// values from <linux/mempolicy.h>, defined here to avoid depending on libnuma
+#define MPOL_F_NODE (1 << 0)
+#define MPOL_F_ADDR (1 << 1)
+#define MPOL_F_MEMS_ALLOWED (1 << 2)
+// from <linux/mman.h>, available since Linux 5.14
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23
+#endif
+#define MPOL_MF_MOVE (1 << 1)
+
+static const int numa_policy_modes[] = {
+    [SHMEX_NUMA_DEFAULT] = 0,
+    [SHMEX_NUMA_PREFERRED] = 1,
+    [SHMEX_NUMA_BIND] = 2,
+    [SHMEX_NUMA_INTERLEAVE] = 3,
+};
+#endif
+
 /**
- * Sets the capacity of shared memory payload. The struct is updated
- * accordingly.
+ * Sets NUMA memory policy of shared memory and faults its pages in, so that
+ * they are placed according to the policy rather than on the node of
+ * the first process touching them.
+ *
+ * For `SHMEX_NUMA_BIND` and `SHMEX_NUMA_PREFERRED` memory is placed on `node`,
+ * `SHMEX_NUMA_INTERLEAVE` spreads it across all allowed nodes and `node` is
+ * ignored. The policy is stored in the shared memory object itself, so it
+ * applies to all processes mapping it, but only to the first `capacity` bytes
+ * - memory added by a later capacity change uses the default policy.
  *
- * Should not be invoked when shm is mapped into the memory.
+ * Pages are faulted in with `madvise(MADV_POPULATE_WRITE)`, which does not
+ * modify their contents, so it is safe to call while other processes write
+ * to the segment. On kernels older than 5.14, pages are faulted in by reading
+ * them instead, and pages not allocated yet may be placed only when first
+ * written.
+ *
+ * If the payload is not mapped, it is mapped for the time of the call.
+ * Fails with `SHMEX_ERROR_MBIND` and errno set to ENOSYS when the OS
+ * does not support NUMA policies. Frozen payloads are refused, since
+ * faulting the pages in for writing requires a writable mapping.
  */
-ShmexLibResult shmex_set_capacity(Shmex *payload, size_t capacity) {
+ShmexLibResult shmex_set_numa_policy(Shmex *payload, ShmexNumaPolicy policy,
+                                     int node) {
+  if (payload->frozen) {
+    return SHMEX_ERROR_FROZEN;
+  }
+
+#ifdef __linux__
+  ShmexLibResult result;
+  int was_mapped = payload->mapped_memory != MAP_FAILED;
+  unsigned long nodemask = 0;
+
+  if (payload->offset != 0) {
+    return SHMEX_ERROR_SLAB_CHUNK;
+  }
+
+  if (policy == SHMEX_NUMA_INTERLEAVE) {
+    // setting bits of nodes not supported by the kernel makes mbind fail
+    // with EINVAL, so only nodes allowed for the process are used
+    int mode;
+    SHMEX_TRACE(get_mempolicy_entry, payload->name, payload->capacity);
+    long res = syscall(SYS_get_mempolicy, &mode, &nodemask,
+                       8 * sizeof(nodemask) + 1, NULL, MPOL_F_MEMS_ALLOWED);
+    SHMEX_TRACE(get_mempolicy_return, payload->name, payload->capacity, res);
+    if (res < 0) {
+      return SHMEX_ERROR_GET_MEMPOLICY;
+    }
+  } else if (policy != SHMEX_NUMA_DEFAULT) {
+    if (node < 0 || node >= (int)(8 * sizeof(nodemask))) {
+      errno = EINVAL;
+      return SHMEX_ERROR_MBIND;
+    }
+    nodemask = 1UL << node;
+  }
+
+  if (!was_mapped) {
+    result = shmex_open_and_mmap(payload);
+    if (SHMEX_RES_OK != result) {
+      return result;
+    }
+  }
+
+  // maxnode is decremented by the kernel, hence + 1
+  SHMEX_TRACE(mbind_entry, payload->name, payload->capacity);
+  long res = syscall(SYS_mbind, payload->mapped_memory, payload->capacity,
+                     numa_policy_modes[policy],
+                     policy == SHMEX_NUMA_DEFAULT ? NULL : &nodemask,
+                     8 * sizeof(nodemask) + 1, MPOL_MF_MOVE);
+  SHMEX_TRACE(mbind_return, payload->name, payload->capacity, res);
+  if (res < 0) {
+    result = SHMEX_ERROR_MBIND;
+    goto shmex_set_numa_policy_exit;
+  }
+
+  // may take long for large segments, that's why the NIF calling it
+  // is dirty
+  SHMEX_TRACE(madvise_entry, payload->name, payload->capacity);
+  res = madvise(payload->mapped_memory, payload->capacity,
+                MADV_POPULATE_WRITE);
+  SHMEX_TRACE(madvise_return, payload->name, payload->capacity, res);
+  if (res < 0) {
+    long page_size = sysconf(_SC_PAGESIZE);
+    volatile char *memory = payload->mapped_memory;
+    for (size_t offset = 0; offset < payload->capacity; offset += page_size) {
+      (void)memory[offset];
+    }
+  }
+
+  result = SHMEX_RES_OK;
+shmex_set_numa_policy_exit:
+  if (!was_mapped) {
+    int mbind_errno = errno;
+    shmex_unmap(payload);
+    errno = mbind_errno;
+  }
+  return result;
+#else
+  (void)payload;
+  (void)policy;
+  (void)node;
+  errno = ENOSYS;
+  return SHMEX_ERROR_MBIND;
+#endif
+}
+
+/**
+ * Gets the NUMA node on which the first page of shared memory resides.
+ * The page is faulted in if it is not present yet.
+ *
+ * Only the first page is queried, so for segments with pages spread across
+ * nodes, e.g. with `SHMEX_NUMA_INTERLEAVE` policy, the result does not
+ * describe the placement of the whole segment.
+ *
+ * If the payload is not mapped, it is mapped for the time of the call.
+ * Fails with `SHMEX_ERROR_GET_MEMPOLICY` and errno set to ENOSYS when the OS
+ * does not support NUMA policies.
+ */
+ShmexLibResult shmex_get_numa_node(Shmex *payload, int *node) {
+#ifdef __linux__
+  ShmexLibResult result;
+  int was_mapped = payload->mapped_memory != MAP_FAILED;
+
+  if (!was_mapped) {
+    result = shmex_open_and_mmap_readonly(payload);
+    if (SHMEX_RES_OK != result) {
+      return result;
+    }
+  }
+
+  SHMEX_TRACE(get_mempolicy_entry, payload->name, payload->capacity);
+  long res = syscall(SYS_get_mempolicy, node, NULL, 0, payload->mapped_memory,
+                     MPOL_F_NODE | MPOL_F_ADDR);
+  SHMEX_TRACE(get_mempolicy_return, payload->name, payload->capacity, res);
+  result = res < 0 ? SHMEX_ERROR_GET_MEMPOLICY : SHMEX_RES_OK;
+
+  if (!was_mapped) {
+    int get_mempolicy_errno = errno;
+    shmex_unmap(payload);
+    errno = get_mempolicy_errno;
+  }
+  return result;
+#else
+  (void)payload;
+  (void)node;
+  errno = ENOSYS;
+  return SHMEX_ERROR_GET_MEMPOLICY;
+#endif
+}
+
+/**
+ * Resizes the mapping of the payload to `capacity` bytes. The payload's
+ * capacity is not updated.
+ *
+ * On Linux, the mapping is resized in place with `mremap` if possible, so
+ * pointers to the mapped memory stay valid. Otherwise, the mapping may be moved
+ * and payload->mapped_memory changes. On other systems, the memory is always
+ * mapped again, with the same protection.
+ */
+static ShmexLibResult remap(Shmex *payload, int fd, size_t capacity) {
+#ifdef __linux__
+  void *memory =
+      mremap(payload->mapped_memory, payload->capacity, capacity, 0);
+  if (MAP_FAILED == memory) {
+    memory = mremap(payload->mapped_memory, payload->capacity, capacity,
+                    MREMAP_MAYMOVE);
+  }
+  if (MAP_FAILED == memory) {
+    return SHMEX_ERROR_MMAP;
+  }
+#else
+  int prot = payload->mapped_writable ? PROT_READ | PROT_WRITE : PROT_READ;
+  void *memory = mmap(NULL, capacity, prot, MAP_SHARED, fd, 0);
+  if (MAP_FAILED == memory) {
+    return SHMEX_ERROR_MMAP;
+  }
+  munmap(payload->mapped_memory, payload->capacity);
+#endif
+  (void)fd;
+  payload->mapped_memory = memory;
+  return SHMEX_RES_OK;
+}
+
+static ShmexLibResult set_capacity(Shmex *payload, size_t capacity,
+                                   uint64_t *accounted_size) {
   ShmexLibResult result;
   int fd = -1;
+  uint64_t reserved = 0;
 
-  if (payload->mapped_memory != MAP_FAILED) {
-    result = SHMEX_ERROR_SHM_MAPPED;
+  if (payload->frozen) {
+    result = SHMEX_ERROR_FROZEN;
     goto shmex_set_capacity_exit;
   }
 
-  fd = shm_open(payload->name, O_RDWR, 0666);
-  if (fd < 0) {
+  if (payload->offset != 0) {
+    if (capacity > payload->capacity) {
+      result = SHMEX_ERROR_SLAB_CHUNK;
+      goto shmex_set_capacity_exit;
+    }
+    if (payload->size > capacity) {
+      payload->size = capacity;
+    }
+    result = SHMEX_RES_OK;
+    goto shmex_set_capacity_exit;
+  }
+
+  result = open_writable(payload, &fd);
+  if (SHMEX_RES_OK != result) {
+    goto shmex_set_capacity_exit;
+  }
+
+  struct stat shm_stat;
+  SHMEX_TRACE(fstat_entry, payload->name, payload->capacity);
+  int stat_res = fstat(fd, &shm_stat);
+  SHMEX_TRACE(fstat_return, payload->name, payload->capacity, stat_res);
+  if (stat_res < 0) {
     result = SHMEX_ERROR_SHM_OPEN;
     goto shmex_set_capacity_exit;
   }
+  uint64_t old_size = shm_stat.st_size;
+  uint64_t accounted =
+      accounted_size ? __atomic_load_n(accounted_size, __ATOMIC_RELAXED) : 0;
+  if (accounted_size && capacity > accounted) {
+    if (reserve_usage(capacity - accounted)) {
+      result = SHMEX_ERROR_BUDGET_EXCEEDED;
+      goto shmex_set_capacity_exit;
+    }
+    reserved = capacity - accounted;
+  }
 
+  SHMEX_TRACE(ftruncate_entry, payload->name, capacity);
   int res = ftruncate(fd, capacity);
+  SHMEX_TRACE(ftruncate_return, payload->name, capacity, res);
   if (res < 0) {
     result = SHMEX_ERROR_FTRUNCATE;
     goto shmex_set_capacity_exit;
   }
+
+  if (payload->mapped_memory != MAP_FAILED) {
+    SHMEX_TRACE(mremap_entry, payload->name, capacity);
+    result = remap(payload, fd, capacity);
+    SHMEX_TRACE(mremap_return, payload->name, capacity, result);
+    if (SHMEX_RES_OK != result) {
+      int remap_errno = errno;
+      if (ftruncate(fd, old_size) < 0 && accounted_size) {
+        // the segment keeps the new size, so it is accounted as resized
+        account_capacity(accounted_size, capacity, reserved);
+        reserved = 0;
+      }
+      errno = remap_errno;
+      goto shmex_set_capacity_exit;
+    }
+  }
+
+  if (accounted_size) {
+    account_capacity(accounted_size, capacity, reserved);
+    reserved = 0;
+  }
   payload->capacity = capacity;
   if (payload->size > capacity) {
     // data was discarded with ftruncate, update size
@@ -159,16 +737,68 @@ shmex_set_capacity_exit:
   if (fd > 0) {
     close(fd);
   }
+  if (SHMEX_RES_OK != result && reserved > 0) {
+    release_usage(reserved);
+  }
   return result;
 }
 
+/**
+ * Sets the capacity of shared memory payload. The struct is updated
+ * accordingly.
+ *
+ * The change of the payload's capacity is reflected in the usage of shared
+ * memory, and growing fails with `SHMEX_ERROR_BUDGET_EXCEEDED` if it would
+ * exceed the budget. Should be used only for segments allocated with
+ * 'shmex_allocate_unguarded' - for other ones use
+ * 'shmex_set_capacity_unaccounted'.
+ *
+ * If the payload is mapped, the mapping is resized as well (see `remap`),
+ * so the memory stays accessible without mapping it again. The mapping may be
+ * moved in the process, so payload->mapped_memory has to be read again after
+ * a successful call - any pointer into the old mapping may be invalid. On
+ * failure, the mapping is left unchanged.
+ *
+ * Slab chunks (payloads with non-zero offset) cannot be resized. Setting their
+ * capacity to at most the current one only limits the size, while growing them
+ * fails with `SHMEX_ERROR_SLAB_CHUNK`.
+ */
+ShmexLibResult shmex_set_capacity(Shmex *payload, size_t capacity) {
+  uint64_t accounted_size = payload->capacity;
+  return set_capacity(payload, capacity, &accounted_size);
+}
+
+/**
+ * Works like 'shmex_set_capacity', but the usage of shared memory is changed
+ * by the difference between `capacity` and `*accounted_size`, which is then
+ * set to `capacity`. Should be used when the accounted size is kept apart
+ * from the payload, e.g. in a guard shared by many payloads. `*accounted_size`
+ * is accessed atomically.
+ */
+ShmexLibResult shmex_set_capacity_accounted(Shmex *payload, size_t capacity,
+                                            uint64_t *accounted_size) {
+  return set_capacity(payload, capacity, accounted_size);
+}
+
+/**
+ * Works like 'shmex_set_capacity', but does not change the usage of shared
+ * memory. Should be used for segments that are not included in the usage,
+ * e.g. allocated by other OS processes.
+ */
+ShmexLibResult shmex_set_capacity_unaccounted(Shmex *payload,
+                                              size_t capacity) {
+  return set_capacity(payload, capacity, NULL);
+}
+
 /**
  * Unlinks shared memory segment. Unlinked segment cannot be mapped again and is
  * freed once all its memory mappings are removed (e.g. via `shmex_release`
  * function). This function has to be called **before** `shmex_release`.
  */
 ShmexLibResult shmex_unlink(Shmex *payload) {
-  if (payload->name != NULL) {
+  if (payload->offset != 0) {
+    return SHMEX_ERROR_SLAB_CHUNK;
+  } else if (payload->name != NULL) {
     shmex_shm_unlink(payload->name);
     return SHMEX_RES_OK;
   } else {
@@ -176,6 +806,19 @@ ShmexLibResult shmex_unlink(Shmex *payload) {
   }
 }
 
+/**
+ * Works like 'shmex_unlink', but additionally subtracts the payload's capacity
+ * from the usage of shared memory. Should be used for segments allocated with
+ * 'shmex_allocate_unguarded' and resized only with 'shmex_set_capacity'.
+ */
+ShmexLibResult shmex_unlink_accounted(Shmex *payload) {
+  ShmexLibResult result = shmex_unlink(payload);
+  if (SHMEX_RES_OK == result) {
+    release_usage(payload->capacity);
+  }
+  return result;
+}
+
 /**
  * Unlinks shared memory segment by name. Works the same way as `shm_unlink`,
  * but contains checks to prevent name conflicts when dealing with SHMs
@@ -185,6 +828,7 @@ void shmex_shm_unlink(char *name) {
   static const unsigned name_cmp_prefix_len =
       SHMEX_SHM_NAME_PREFIX_LEN + SHMEX_SHM_NAME_TIME_ID_LEN;
   char current_name[SHMEX_SHM_NAME_LEN];
+  uint64_t start_ns = now_ns();
   if (!strncmp(name, SHMEX_SHM_NAME_PREFIX, SHMEX_SHM_NAME_PREFIX_LEN)) {
     // The busy wait below applies only to SHMs with names generated by Shmex
     // and guarantees that such names will not be reused. Although this is a
@@ -205,7 +849,79 @@ void shmex_shm_unlink(char *name) {
       shmex_generate_shm_name(current_name, 0);
     } while (strncmp(name, current_name, name_cmp_prefix_len) >= 0);
   }
-  shm_unlink(name);
+  uint64_t unlink_start_ns = now_ns();
+  SHMEX_TRACE(unlink_entry, name, 0);
+  int res = shm_unlink(name);
+  SHMEX_TRACE(unlink_return, name, 0, res);
+  STAT_ADD(unlinks, 1);
+  STAT_ADD(unlink_wait_ns, unlink_start_ns - start_ns);
+  STAT_ADD(unlink_ns, now_ns() - unlink_start_ns);
+}
+
+/**
+ * Subtracts `bytes` from the usage of shared memory. Should be used to release
+ * segments allocated with 'shmex_allocate_unguarded' that are unlinked with
+ * 'shmex_shm_unlink', passing the size they were accounted with.
+ */
+void shmex_release_usage(uint64_t bytes) {
+  release_usage(bytes);
+}
+
+/**
+ * Sets the budget: the maximum number of bytes of shared memory that can be
+ * allocated with this library in the current OS process. 0 means no limit.
+ *
+ * Lowering the budget below the current usage does not free any memory,
+ * it only makes further allocations fail.
+ */
+void shmex_set_budget(uint64_t new_budget) {
+  __atomic_store_n(&budget, new_budget, __ATOMIC_RELAXED);
+}
+
+uint64_t shmex_get_budget(void) {
+  return __atomic_load_n(&budget, __ATOMIC_RELAXED);
+}
+
+/**
+ * Returns the number of bytes of shared memory allocated with this library
+ * in the current OS process and not unlinked yet.
+ */
+uint64_t shmex_get_usage(void) {
+  return __atomic_load_n(&usage, __ATOMIC_RELAXED);
+}
+
+/**
+ * Copies allocation counters gathered since the library was loaded
+ * (or since the last call to `shmex_reset_alloc_stats`).
+ *
+ * The counters are updated with relaxed atomics, so a snapshot taken while
+ * other threads allocate may be slightly inconsistent between fields.
+ */
+void shmex_get_alloc_stats(ShmexAllocStats *stats) {
+  stats->allocations =
+      __atomic_load_n(&alloc_stats.allocations, __ATOMIC_RELAXED);
+  stats->failures = __atomic_load_n(&alloc_stats.failures, __ATOMIC_RELAXED);
+  stats->name_retries =
+      __atomic_load_n(&alloc_stats.name_retries, __ATOMIC_RELAXED);
+  stats->shm_open_ns =
+      __atomic_load_n(&alloc_stats.shm_open_ns, __ATOMIC_RELAXED);
+  stats->ftruncate_ns =
+      __atomic_load_n(&alloc_stats.ftruncate_ns, __ATOMIC_RELAXED);
+  stats->unlinks = __atomic_load_n(&alloc_stats.unlinks, __ATOMIC_RELAXED);
+  stats->unlink_wait_ns =
+      __atomic_load_n(&alloc_stats.unlink_wait_ns, __ATOMIC_RELAXED);
+  stats->unlink_ns = __atomic_load_n(&alloc_stats.unlink_ns, __ATOMIC_RELAXED);
+}
+
+void shmex_reset_alloc_stats(void) {
+  __atomic_store_n(&alloc_stats.allocations, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&alloc_stats.failures, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&alloc_stats.name_retries, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&alloc_stats.shm_open_ns, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&alloc_stats.ftruncate_ns, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&alloc_stats.unlinks, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&alloc_stats.unlink_wait_ns, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&alloc_stats.unlink_ns, 0, __ATOMIC_RELAXED);
 }
 
 const char *shmex_lib_result_to_string(ShmexLibResult result) {
@@ -222,6 +938,22 @@ const char *shmex_lib_result_to_string(ShmexLibResult result) {
     return "shm_is_mapped";
   case SHMEX_ERROR_INVALID_PAYLOAD:
     return "invalid_payload";
+  case SHMEX_ERROR_MBIND:
+    return "mbind";
+  case SHMEX_ERROR_GET_MEMPOLICY:
+    return "get_mempolicy";
+  case SHMEX_ERROR_FCHMOD:
+    return "fchmod";
+  case SHMEX_ERROR_FROZEN:
+    return "frozen";
+  case SHMEX_ERROR_SLAB_CHUNK:
+    return "slab_chunk";
+  case SHMEX_ERROR_SLAB_FULL:
+    return "slab_full";
+  case SHMEX_ERROR_BUDGET_EXCEEDED:
+    return "budget_exceeded";
+  case SHMEX_ERROR_INVALID_RANGE:
+    return "invalid_range";
   default:
     return "unknown";
   }
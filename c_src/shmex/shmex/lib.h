@@ -2,6 +2,7 @@
 
 #include <math.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
@@ -12,7 +13,7 @@
 #include <ei.h>
 #endif
 
-#define SHMEX_ELIXIR_STRUCT_ENTRIES 5
+#define SHMEX_ELIXIR_STRUCT_ENTRIES 7
 #define SHMEX_SHM_NAME_PREFIX "/shmex-"
 #define SHMEX_ALLOC_MAX_ATTEMPTS 1000
 #define SHMEX_SHM_NAME_PREFIX_LEN strlen(SHMEX_SHM_NAME_PREFIX)
@@ -21,12 +22,21 @@
   (SHMEX_SHM_NAME_PREFIX_LEN + SHMEX_SHM_NAME_TIME_ID_LEN +                    \
    (1 + (int)ceil(log10(SHMEX_ALLOC_MAX_ATTEMPTS))) + 1)
 #define SHMEX_ELIXIR_STRUCT_ATOM "Elixir.Shmex"
+// see `Shmex.to_compact/1`
+#define SHMEX_COMPACT_ENTRIES 7
+#define SHMEX_COMPACT_ATOM "shmex"
+// zero-filled ranges smaller than that are written rather than released
+#define SHMEX_FILL_HOLE_MIN_SIZE (64 * 1024)
 
 typedef struct {
   char *name;
   unsigned int size;
   unsigned int capacity;
+  unsigned int offset;
+  int frozen;
   void *mapped_memory;
+  // whether mapped_memory is writable, valid only when it is mapped
+  int mapped_writable;
 #ifdef SHMEX_NIF
   ERL_NIF_TERM guard;
 #endif
@@ -40,15 +50,64 @@ typedef enum ShmexLibResult {
   SHMEX_ERROR_SHM_OPEN,
   SHMEX_ERROR_FTRUNCATE,
   SHMEX_ERROR_MMAP,
+  // not returned since shm can be resized while mapped, kept for compatibility
   SHMEX_ERROR_SHM_MAPPED,
-  SHMEX_ERROR_INVALID_PAYLOAD
+  SHMEX_ERROR_INVALID_PAYLOAD,
+  SHMEX_ERROR_MBIND,
+  SHMEX_ERROR_GET_MEMPOLICY,
+  SHMEX_ERROR_FCHMOD,
+  SHMEX_ERROR_FROZEN,
+  SHMEX_ERROR_SLAB_CHUNK,
+  SHMEX_ERROR_SLAB_FULL,
+  SHMEX_ERROR_BUDGET_EXCEEDED,
+  SHMEX_ERROR_INVALID_RANGE
 } ShmexLibResult;
 
+typedef enum ShmexNumaPolicy {
+  SHMEX_NUMA_DEFAULT,
+  SHMEX_NUMA_PREFERRED,
+  SHMEX_NUMA_BIND,
+  SHMEX_NUMA_INTERLEAVE
+} ShmexNumaPolicy;
+
+/**
+ * Counters describing the behaviour of allocations performed by the library
+ * in the current OS process. All durations are in nanoseconds.
+ */
+typedef struct ShmexAllocStats {
+  uint64_t allocations;
+  uint64_t failures;
+  uint64_t name_retries;
+  uint64_t shm_open_ns;
+  uint64_t ftruncate_ns;
+  uint64_t unlinks;
+  uint64_t unlink_wait_ns;
+  uint64_t unlink_ns;
+} ShmexAllocStats;
+
 void shmex_generate_shm_name(char *name, int attempt);
 ShmexLibResult shmex_allocate_unguarded(Shmex *payload);
 ShmexLibResult shmex_open_and_mmap(Shmex *payload);
+ShmexLibResult shmex_open_and_mmap_readonly(Shmex *payload);
+ShmexLibResult shmex_freeze(Shmex *payload);
+ShmexLibResult shmex_fill(Shmex *payload, size_t offset, size_t length,
+                          const void *pattern, size_t pattern_size);
 ShmexLibResult shmex_set_capacity(Shmex *payload, size_t capacity);
+ShmexLibResult shmex_set_capacity_accounted(Shmex *payload, size_t capacity,
+                                            uint64_t *accounted_size);
+ShmexLibResult shmex_set_capacity_unaccounted(Shmex *payload,
+                                              size_t capacity);
 void shmex_unmap(Shmex *payload);
+ShmexLibResult shmex_set_numa_policy(Shmex *payload, ShmexNumaPolicy policy,
+                                     int node);
+ShmexLibResult shmex_get_numa_node(Shmex *payload, int *node);
 ShmexLibResult shmex_unlink(Shmex *payload);
+ShmexLibResult shmex_unlink_accounted(Shmex *payload);
 const char *shmex_lib_result_to_string(ShmexLibResult result);
 void shmex_shm_unlink(char *name);
+void shmex_release_usage(uint64_t bytes);
+void shmex_set_budget(uint64_t budget);
+uint64_t shmex_get_budget(void);
+uint64_t shmex_get_usage(void);
+void shmex_get_alloc_stats(ShmexAllocStats *stats);
+void shmex_reset_alloc_stats(void);
@@ -0,0 +1,37 @@
+#pragma once
+
+/**
+ * Static tracepoints (USDT) placed around syscalls and copies performed
+ * by Shmex, that can be attached to with bpftrace, perf or SystemTap
+ * without rebuilding, e.g.
+ *
+ *   bpftrace -e 'usdt:./priv/bundlex/nif/shmex.so:shmex:mmap_entry
+ *                { @start[tid] = nsecs; }
+ *                usdt:./priv/bundlex/nif/shmex.so:shmex:mmap_return
+ *                { @mmap_ns = hist(nsecs - @start[tid]); }'
+ *
+ * Each probe is a single nop instruction when not traced. The probes are
+ * available when <sys/sdt.h> (e.g. from systemtap-sdt-dev package) is present
+ * during compilation, unless SHMEX_NO_TRACE is defined. bundlex.exs warns when
+ * the header is missing and defines SHMEX_NO_TRACE in that case.
+ */
+
+#if !defined(SHMEX_NO_TRACE) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define SHMEX_TRACE_ENABLED
+#endif
+#endif
+
+#ifdef SHMEX_TRACE_ENABLED
+#define SHMEX_TRACE(probe, ...) STAP_PROBEV(shmex, probe, __VA_ARGS__)
+#else
+static inline void shmex_trace_unused(int dummy, ...) { (void)dummy; }
+// Arguments are referenced, but never evaluated, to avoid unused variable
+// warnings when tracing is disabled
+#define SHMEX_TRACE(probe, ...)                                                \
+  do {                                                                         \
+    if (0)                                                                     \
+      shmex_trace_unused(0, __VA_ARGS__);                                      \
+  } while (0)
+#endif
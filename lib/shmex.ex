@@ -19,25 +19,71 @@ defmodule Shmex do
 
   Shared memory should be available as long as the associated struct is not
   garbage collected.
+
+  Frozen shared memory (see `#{inspect(Native)}.freeze/1`) is read-only and
+  can be shared with many readers without copying.
+
+  Non-zero `offset` means that the struct describes a chunk of a larger
+  segment, see `#{inspect(Native)}.slab_create/2`.
   """
   @type t :: %__MODULE__{
           name: binary() | nil,
           guard: reference() | nil,
           size: non_neg_integer(),
-          capacity: pos_integer()
+          capacity: pos_integer(),
+          offset: non_neg_integer(),
+          frozen: boolean()
         }
 
+  @typedoc """
+  Compact representation of `t:t/0`, cheaper to encode and decode
+  in native code, especially in CNodes.
+
+  See `to_compact/1` and `from_compact/1`.
+  """
+  @type compact ::
+          {:shmex, name :: binary() | nil, guard :: reference() | nil,
+           size :: non_neg_integer(), capacity :: pos_integer(), offset :: non_neg_integer(),
+           frozen :: boolean()}
+
   @default_capacity 4096
 
-  defstruct name: nil, guard: nil, size: 0, capacity: @default_capacity
+  defstruct name: nil,
+            guard: nil,
+            size: 0,
+            capacity: @default_capacity,
+            offset: 0,
+            frozen: false
 
   @doc """
   Creates a new, empty shared memory area with the given capacity
+
+  Options:
+  - `numa` - NUMA memory policy applied to the shared memory before its pages
+    are faulted in, see `#{inspect(Native)}.set_numa_policy/2`. By default,
+    pages are placed on the node of the process touching them first.
+  - `zeroed` - if `true`, the size of the returned shared memory is equal
+    to its capacity, so it contains `capacity` zero bytes. Newly allocated
+    shared memory is guaranteed to be zeroed by the OS, so no data is written.
+    Defaults to `false`.
   """
-  @spec empty(capacity :: pos_integer) :: t()
-  def empty(capacity \\ @default_capacity) do
+  @spec empty(
+          capacity :: pos_integer,
+          options :: [numa: Native.numa_policy(), zeroed: boolean()]
+        ) :: t()
+  def empty(capacity \\ @default_capacity, options \\ []) do
     {:ok, data} = create(capacity)
-    data
+
+    case Keyword.fetch(options, :numa) do
+      {:ok, policy} -> :ok = Native.set_numa_policy(data, policy)
+      :error -> :ok
+    end
+
+    if Keyword.get(options, :zeroed, false) do
+      %__MODULE__{data | size: capacity}
+    else
+      data
+    end
   end
 
   @doc """
@@ -92,6 +138,34 @@ defmodule Shmex do
     binary
   end
 
+  @doc """
+  Converts shared memory struct into the compact form.
+
+  The compact form can be decoded by the native code (`shmex_deserialize`
+  in CNodes and `shmex_get_from_term` in NIFs) without looking up the struct keys
+  and should be used when passing large amounts of shared memory structs to
+  the native code. Use `from_compact/1` to convert it back.
+  """
+  @spec to_compact(t()) :: compact()
+  def to_compact(%__MODULE__{} = shm) do
+    {:shmex, shm.name, shm.guard, shm.size, shm.capacity, shm.offset, shm.frozen}
+  end
+
+  @doc """
+  Converts shared memory struct from the compact form, see `to_compact/1`.
+  """
+  @spec from_compact(compact()) :: t()
+  def from_compact({:shmex, name, guard, size, capacity, offset, frozen}) do
+    %__MODULE__{
+      name: name,
+      guard: guard,
+      size: size,
+      capacity: capacity,
+      offset: offset,
+      frozen: frozen
+    }
+  end
+
   defp create(capacity) do
     shm_struct = %__MODULE__{capacity: capacity}
     Native.allocate(shm_struct)
@@ -15,7 +15,7 @@ defmodule Shmex.Native do
   using it unmaps it
   """
   @spec allocate(Shmex.t()) ::
-          {:ok, Shmex.t()} | {:error, {:file.posix(), :ftruncate}}
+          {:ok, Shmex.t()} | {:error, :budget_exceeded | {:file.posix(), :ftruncate}}
   defnif allocate(shm)
 
   @doc """
@@ -34,7 +34,8 @@ defmodule Shmex.Native do
   Sets the capacity of shared memory area and updates the Shmex struct accordingly.
   """
   @spec set_capacity(Shmex.t(), capacity :: pos_integer()) ::
-          {:ok, Shmex.t()} | {:error, {:file.posix(), :shm_open | :ftruncate}}
+          {:ok, Shmex.t()}
+          | {:error, :frozen | :slab_chunk | {:file.posix(), :shm_open | :ftruncate}}
   defnif set_capacity(shm, capacity)
 
   @doc """
@@ -61,9 +62,193 @@ defmodule Shmex.Native do
   to fit the data.
   """
   @spec write(Shmex.t(), data :: binary()) ::
-          {:ok, Shmex.t()} | {:error, {:file.posix(), :shm_open | :mmap}}
+          {:ok, Shmex.t()}
+          | {:error, :frozen | :slab_chunk | {:file.posix(), :shm_open | :mmap | :ftruncate}}
   defnif write(shm, data)
 
+  @doc """
+  Fills `length` bytes of shared memory starting at `offset` with the given
+  byte or repeated pattern, without building the data in Elixir.
+
+  Size of shared memory is increased to `offset + length` if it is smaller.
+  If `offset` exceeds the size, the bytes between the size and `offset` are
+  zeroed. The capacity is not changed, so if the range exceeds it,
+  `{:error, :invalid_range}` is returned.
+
+  When filling with zeros on Linux, whole pages inside large ranges are released
+  instead of being written, which makes dropping the recycled content cheap.
+  """
+  @spec fill(
+          Shmex.t(),
+          offset :: non_neg_integer(),
+          length :: non_neg_integer(),
+          byte_or_pattern :: byte() | binary()
+        ) ::
+          {:ok, Shmex.t()}
+          | {:error, :frozen | :invalid_range | {:file.posix(), :shm_open | :mmap}}
+  def fill(shm, offset, length, byte) when is_integer(byte) and byte in 0..255 do
+    fill_pattern(shm, offset, length, <<byte>>)
+  end
+
+  def fill(shm, offset, length, pattern) when is_binary(pattern) and byte_size(pattern) > 0 do
+    fill_pattern(shm, offset, length, pattern)
+  end
+
+  defnifp fill_pattern(shm, offset, length, pattern)
+
+  @doc """
+  Reads the contents of a file directly into the shared memory.
+
+  Overwrites the existing content and sets the size to the number of bytes read.
+  Increases the capacity of shared memory to fit the data. The data does not
+  pass through the BEAM heap and the function runs on a dirty IO scheduler.
+
+  Options:
+  - `offset` - position in the file to read from, `0` by default
+  - `length` - number of bytes to read, `:eof` (default) reads until the end
+    of the file. If the file ends earlier, less bytes are read.
+
+  Reading consecutive chunks allows streaming a file through shared memory.
+  """
+  @spec from_file(
+          Shmex.t(),
+          Path.t(),
+          options :: [offset: non_neg_integer(), length: non_neg_integer() | :eof]
+        ) ::
+          {:ok, Shmex.t()}
+          | {:error,
+             :frozen
+             | :invalid_length
+             | {:file.posix(), :open | :fstat | :pread | :shm_open | :mmap | :ftruncate}}
+  def from_file(shm, path, options \\ []) do
+    offset = Keyword.get(options, :offset, 0)
+
+    length =
+      case Keyword.get(options, :length, :eof) do
+        :eof -> -1
+        length -> length
+      end
+
+    read_from_file(shm, IO.chardata_to_string(path), offset, length)
+  end
+
+  defnifp read_from_file(shm, path, offset, length)
+
+  @doc """
+  Writes the contents of shared memory directly to a file.
+
+  The data does not pass through the BEAM heap and the function runs
+  on a dirty IO scheduler. The file is created if it does not exist.
+
+  Options:
+  - `offset` - position in the file to write at. If not provided, the file
+    is truncated and written from the beginning. Otherwise, the file is
+    not truncated, which allows writing it in consecutive chunks.
+  - `source_offset` - position in shared memory to write from, `0` by default
+  - `length` - number of bytes to write, by default all the data past
+    `source_offset`. If the range exceeds the size of shared memory,
+    `{:error, :invalid_range}` is returned.
+  """
+  @spec to_file(
+          Shmex.t(),
+          Path.t(),
+          options :: [
+            offset: non_neg_integer(),
+            source_offset: non_neg_integer(),
+            length: non_neg_integer()
+          ]
+        ) ::
+          :ok | {:error, :invalid_range | {:file.posix(), :open | :pwrite | :shm_open | :mmap}}
+  def to_file(shm, path, options \\ []) do
+    offset = Keyword.get(options, :offset, -1)
+    source_offset = Keyword.get(options, :source_offset, 0)
+    length = Keyword.get(options, :length, -1)
+    write_to_file(shm, IO.chardata_to_string(path), offset, source_offset, length)
+  end
+
+  defnifp write_to_file(shm, path, offset, source_offset, length)
+
+  @typedoc """
+  File descriptor of a socket.
+
+  It can be obtained with `:socket.getopt(socket, {:otp, :fd})` for `:socket`
+  sockets or with `:inet.getfd(socket)` for `:gen_udp` and `:gen_tcp` ones.
+  """
+  @type socket_fd :: non_neg_integer()
+
+  @doc """
+  Receives a single datagram (or a portion of a stream) from a socket directly
+  into the shared memory, at `offset`.
+
+  At most `shm.capacity - offset` bytes are received, so a datagram not fitting
+  into the shared memory is truncated. The size of the returned shared memory
+  is set to the end of the received data.
+
+  The receive is non-blocking: `{:error, {:eagain, :recv}}` is returned when
+  there is no data available.
+  """
+  @spec socket_recv(Shmex.t(), socket_fd(), offset :: non_neg_integer()) ::
+          {:ok, Shmex.t()}
+          | {:error, :frozen | :invalid_range | {:file.posix(), :shm_open | :mmap | :recv}}
+  defnif socket_recv(shm, fd, offset)
+
+  @doc """
+  Receives up to `max_count` datagrams from a socket directly into the shared
+  memory with a single syscall (`recvmmsg` on Linux).
+
+  The i-th datagram is placed at offset `i * slot_size` and truncated if it
+  exceeds `slot_size`. Returns the shared memory along with a
+  `{length, truncated?}` tuple for each received datagram, where `length` is
+  the number of bytes stored in the slot. The size of the returned shared
+  memory is set to the end of the last datagram. At most 1024 datagrams can be
+  received at once.
+
+  The receive is non-blocking: `{:error, {:eagain, :recv}}` is returned when
+  there is no data available.
+  """
+  @spec socket_recv_batch(
+          Shmex.t(),
+          socket_fd(),
+          slot_size :: pos_integer(),
+          max_count :: pos_integer()
+        ) ::
+          {:ok, {Shmex.t(), [{length :: non_neg_integer(), truncated? :: boolean()}]}}
+          | {:error, :frozen | :invalid_range | {:file.posix(), :shm_open | :mmap | :recv}}
+  defnif socket_recv_batch(shm, fd, slot_size, max_count)
+
+  @doc """
+  Sends `length` bytes of the shared memory, starting at `offset`, through
+  a connected socket. Returns the number of bytes sent.
+
+  The send is non-blocking: `{:error, {:eagain, :send}}` is returned when
+  the socket buffer is full.
+  """
+  @spec socket_send(
+          Shmex.t(),
+          socket_fd(),
+          offset :: non_neg_integer(),
+          length :: non_neg_integer()
+        ) ::
+          {:ok, non_neg_integer()}
+          | {:error, :invalid_range | {:file.posix(), :shm_open | :mmap | :send}}
+  defnif socket_send(shm, fd, offset, length)
+
+  @doc """
+  Sends many datagrams, each described by an `{offset, length}` range of the
+  shared memory, through a connected socket with a single syscall (`sendmmsg`
+  on Linux). Returns the number of datagrams sent, which may be less than
+  the number of ranges. At most 1024 datagrams can be sent at once.
+
+  The send is non-blocking: `{:error, {:eagain, :send}}` is returned when
+  the socket buffer is full.
+  """
+  @spec socket_send_batch(Shmex.t(), socket_fd(), [
+          {offset :: non_neg_integer(), length :: non_neg_integer()}
+        ]) ::
+          {:ok, non_neg_integer()}
+          | {:error, :invalid_range | {:file.posix(), :shm_open | :mmap | :send}}
+  defnif socket_send_batch(shm, fd, ranges)
+
   @doc """
   Splits the contents of shared memory area into two by moving the data past
   the specified position into a new shared memory.
@@ -89,9 +274,30 @@ defmodule Shmex.Native do
   The second one, the source, will remain unmodified.
   """
   @spec append(target :: Shmex.t(), source :: Shmex.t()) ::
-          {:ok, Shmex.t()} | {:error, {:file.posix(), :shm_open | :mmap | :ftruncate}}
+          {:ok, Shmex.t()}
+          | {:error, :frozen | :slab_chunk | {:file.posix(), :shm_open | :mmap | :ftruncate}}
   defnif append(target, source)
 
+  @doc """
+  Makes shared memory read-only.
+
+  Permissions of the shared memory segment are set to read-only and the returned
+  struct is marked as frozen. Functions modifying the contents or capacity
+  of the segment return `{:error, :frozen}`, also when given a copy of the struct
+  that is not marked as frozen, as they check the permissions of the segment.
+  This allows handing the same shared memory to many readers without defensive
+  copies.
+
+  POSIX shared memory does not support sealing, so the following is not
+  prevented:
+  - writing through mappings created by other OS processes before freezing,
+  - writing by native code not using Shmex that runs as the owner of the segment,
+    which can restore its permissions, or with superuser privileges.
+  """
+  @spec freeze(Shmex.t()) ::
+          {:ok, Shmex.t()} | {:error, :slab_chunk | {:file.posix(), :shm_open | :fchmod}}
+  defnif freeze(shm)
+
   @doc """
   Ensures that shared memory is not garbage collected at the point of executing
   this function.
@@ -102,6 +308,185 @@ defmodule Shmex.Native do
   @spec ensure_not_gc(Shmex.t()) :: :ok
   defnif ensure_not_gc(shm)
 
+  @typedoc """
+  Reference to a slab created with `slab_create/2`.
+  """
+  @opaque slab :: reference()
+
+  @doc """
+  Creates a slab: a single shared memory segment divided into `chunk_count`
+  chunks of `chunk_size` bytes, which can be obtained with `slab_allocate/1`.
+
+  Compared to allocating a separate shared memory segment for each buffer, it
+  avoids the page-size minimum, a tmpfs inode and several syscalls per buffer,
+  which pays off for many small buffers. Chunk size is rounded up to
+  a multiple of 64 bytes.
+
+  The segment is unlinked once the slab and all its chunks are garbage collected.
+  """
+  @spec slab_create(chunk_size :: pos_integer(), chunk_count :: pos_integer()) ::
+          {:ok, slab()} | {:error, :invalid_slab_size | {:file.posix(), :shm_open | :ftruncate}}
+  defnif slab_create(chunk_size, chunk_count)
+
+  @doc """
+  Takes a free chunk from the slab.
+
+  The returned `Shmex` struct refers to the chunk via its `offset` and can be
+  used like any other, except that its capacity cannot be changed - functions
+  that would need to grow it return `{:error, :slab_chunk}`, while shrinking
+  only limits the size. The chunk is returned
+  to the slab when the struct is garbage collected. Its contents are not cleared.
+  """
+  @spec slab_allocate(slab()) :: {:ok, Shmex.t()} | {:error, :slab_full}
+  defnif slab_allocate(slab)
+
+  @typedoc """
+  NUMA memory policy of shared memory.
+
+  - `{:bind, node}` - memory is allocated only on `node`
+  - `{:preferred, node}` - memory is allocated on `node` if possible
+  - `:interleave` - memory is interleaved across all allowed nodes
+  - `:default` - memory is allocated according to the policy of the process
+    touching it first
+  """
+  @type numa_policy ::
+          {:bind, non_neg_integer()}
+          | {:preferred, non_neg_integer()}
+          | :interleave
+          | :default
+
+  @numa_policies %{default: 0, preferred: 1, bind: 2, interleave: 3}
+
+  @doc """
+  Sets NUMA memory policy of shared memory and faults its pages in, so that
+  they are placed according to the policy.
+
+  Faulting pages in does not modify their contents, so the policy can be set
+  for shared memory that other processes write to. On Linux older than 5.14,
+  pages are only read, so pages that were never written may be placed
+  when they are first written.
+
+  The policy is kept by the shared memory segment and concerns all processes
+  mapping it, but applies only to the current capacity - memory added
+  by increasing the capacity afterwards falls back to the default policy.
+
+  Supported only on Linux, returns `{:error, {:enosys, :mbind}}` elsewhere.
+  """
+  @spec set_numa_policy(Shmex.t(), numa_policy()) ::
+          :ok
+          | {:error,
+             :frozen
+             | :slab_chunk
+             | {:file.posix(), :shm_open | :mmap | :mbind | :get_mempolicy}}
+  def set_numa_policy(shm, {policy, node}) when policy in [:bind, :preferred] do
+    set_numa_policy(shm, @numa_policies[policy], node)
+  end
+
+  def set_numa_policy(shm, policy) when policy in [:interleave, :default] do
+    set_numa_policy(shm, @numa_policies[policy], 0)
+  end
+
+  defnifp set_numa_policy(shm, policy, node)
+
+  @doc """
+  Returns the NUMA node on which the first page of shared memory resides.
+
+  Other pages may reside on different nodes, in particular with the `:interleave`
+  policy.
+
+  Supported only on Linux, returns `{:error, {:enosys, :get_mempolicy}}` elsewhere.
+  """
+  @spec numa_node(Shmex.t()) ::
+          {:ok, non_neg_integer()}
+          | {:error, {:file.posix(), :shm_open | :mmap | :get_mempolicy}}
+  defnif numa_node(shm)
+
+  @doc """
+  Sets the budget: the maximum number of bytes of shared memory that can be
+  allocated by Shmex in the current OS process at once.
+
+  When the budget would be exceeded, allocating or growing shared memory fails
+  with `{:error, :budget_exceeded}`, instead of failing in the middle
+  of a pipeline once the tmpfs is full. The budget is not enforced by default.
+
+  Only shared memory allocated by Shmex counts towards the budget.
+  Shared memory guarded with `add_guard/1` is not taken into account.
+  """
+  @spec set_budget(pos_integer() | :infinity) :: :ok
+  def set_budget(:infinity), do: set_budget_bytes(0)
+  def set_budget(bytes) when is_integer(bytes) and bytes > 0, do: set_budget_bytes(bytes)
+
+  defnifp set_budget_bytes(bytes)
+
+  @doc """
+  Returns the number of bytes of shared memory allocated by Shmex in the current
+  OS process and the budget, see `set_budget/1`.
+  """
+  @spec usage() :: {:ok, %{usage: non_neg_integer(), budget: pos_integer() | :infinity}}
+  def usage() do
+    {:ok, {usage, budget}} = get_usage()
+    {:ok, %{usage: usage, budget: if(budget == 0, do: :infinity, else: budget)}}
+  end
+
+  defnifp get_usage()
+
+  @doc """
+  Subscribes the calling process for notifications about the usage of shared
+  memory (see `usage/0`) crossing the `watermark`.
+
+  Each time the usage gets at or above the watermark,
+  `{:shmex_usage, :above, watermark, usage}` is sent, and each time it gets
+  back below it, `{:shmex_usage, :below, watermark, usage}` is sent. This
+  allows applying backpressure before the budget is exceeded. Returns
+  the position of the current usage relative to the watermark.
+
+  A process can subscribe for many watermarks. At most 64 subscriptions can
+  exist at once. Notifications caused by concurrent changes of the usage may
+  arrive out of order, so `usage/0` should be used when the current value
+  matters.
+  """
+  @spec subscribe_usage(watermark :: non_neg_integer()) ::
+          {:ok, :above | :below} | {:error, :too_many_subscriptions}
+  defnif subscribe_usage(watermark)
+
+  @doc """
+  Removes all subscriptions of the calling process created with `subscribe_usage/1`.
+  """
+  @spec unsubscribe_usage() :: :ok
+  defnif unsubscribe_usage()
+
+  @typedoc """
+  Allocation counters gathered by the native library in the current OS process.
+
+  `name_retries` counts the additional `shm_open` attempts caused by name
+  collisions, while the `*_ns` fields hold the total time spent in the respective
+  syscalls (`unlink_wait_ns` is the busy wait preventing name reuse, see
+  `shmex_shm_unlink` in `lib.c`).
+  """
+  @type alloc_stats :: %{
+          allocations: non_neg_integer(),
+          failures: non_neg_integer(),
+          name_retries: non_neg_integer(),
+          shm_open_ns: non_neg_integer(),
+          ftruncate_ns: non_neg_integer(),
+          unlinks: non_neg_integer(),
+          unlink_wait_ns: non_neg_integer(),
+          unlink_ns: non_neg_integer()
+        }
+
+  @doc """
+  Returns allocation counters gathered since the NIF was loaded or since
+  the last call to `reset_alloc_stats/0`.
+  """
+  @spec alloc_stats() :: {:ok, alloc_stats()}
+  defnif alloc_stats()
+
+  @doc """
+  Resets counters returned by `alloc_stats/0`.
+  """
+  @spec reset_alloc_stats() :: :ok
+  defnif reset_alloc_stats()
+
   @doc """
   Trims shared memory capacity to match its size.
   """
@@ -0,0 +1,78 @@
+defmodule Shmex.CNodeCodecTest do
+  use ExUnit.Case, async: true
+
+  # Tests the encoding used by CNodes with a program built from
+  # test/support/cnode_codec.c, that decodes a Shmex struct and encodes it back
+  # both in the compact and in the struct form.
+
+  @moduletag :cnode_codec
+  @moduletag :tmp_dir
+
+  setup_all do
+    erl_interface = :code.lib_dir(:erl_interface)
+    build_dir = Path.join(System.tmp_dir!(), "shmex_cnode_codec")
+    File.mkdir_p!(build_dir)
+    executable = Path.join(build_dir, "cnode_codec")
+
+    sources = [
+      "test/support/cnode_codec.c",
+      "c_src/shmex/cnode/shmex/shmex.c",
+      "c_src/shmex/shmex/lib.c"
+    ]
+
+    libs = if :os.type() == {:unix, :linux}, do: ["-lrt"], else: []
+
+    args =
+      [
+        "-o",
+        executable,
+        "-Ic_src/shmex/cnode",
+        "-Ic_src/shmex",
+        "-I#{erl_interface}/include",
+        "-L#{erl_interface}/lib"
+      ] ++ sources ++ ["-lei", "-lpthread", "-lm"] ++ libs
+
+    {output, status} = System.cmd("cc", args, stderr_to_stdout: true)
+    assert status == 0, output
+    [executable: executable]
+  end
+
+  defp roundtrip(term, %{executable: executable, tmp_dir: tmp_dir}) do
+    input = Path.join(tmp_dir, "input")
+    output = Path.join(tmp_dir, "output")
+    File.write!(input, :erlang.term_to_binary(term))
+
+    case System.cmd(executable, [input, output]) do
+      {_output, 0} -> {:ok, output |> File.read!() |> :erlang.binary_to_term()}
+      {_output, status} -> {:error, status}
+    end
+  end
+
+  test "decodes the struct and encodes it in both forms", ctx do
+    shm = %Shmex{Shmex.new("some testing data") | offset: 64, frozen: true}
+    assert {:ok, {compact, map}} = roundtrip(shm, ctx)
+    assert compact == Shmex.to_compact(shm)
+    assert map == shm
+  end
+
+  test "decodes the compact form", ctx do
+    shm = Shmex.new("some testing data")
+    assert {:ok, {compact, map}} = roundtrip(Shmex.to_compact(shm), ctx)
+    assert compact == Shmex.to_compact(shm)
+    assert map == shm
+  end
+
+  test "decodes the struct without offset and frozen flag", ctx do
+    shm = Shmex.new("some testing data")
+    legacy = shm |> Map.from_struct() |> Map.drop([:offset, :frozen])
+    legacy = Map.put(legacy, :__struct__, Shmex)
+    assert map_size(legacy) == 5
+    assert {:ok, {_compact, map}} = roundtrip(legacy, ctx)
+    assert map == shm
+  end
+
+  test "rejects the struct without required keys", ctx do
+    shm = Shmex.new("some testing data")
+    assert roundtrip(Map.delete(shm, :capacity), ctx) == {:error, 1}
+  end
+end
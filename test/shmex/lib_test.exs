@@ -0,0 +1,37 @@
+defmodule Shmex.LibTest do
+  use ExUnit.Case, async: true
+
+  # Runs checks of the native library written in C, that are built from
+  # test/support/lib_*.c with the library sources.
+
+  @moduletag :c_compiler
+  @moduletag :tmp_dir
+
+  defp run_c_test(name, %{tmp_dir: tmp_dir}) do
+    executable = Path.join(tmp_dir, name)
+    libs = if :os.type() == {:unix, :linux}, do: ["-lrt"], else: []
+
+    args =
+      ["-o", executable, "-Ic_src/shmex", "test/support/#{name}.c", "c_src/shmex/shmex/lib.c"] ++
+        ["-lm"] ++ libs
+
+    {output, status} = System.cmd("cc", args, stderr_to_stdout: true)
+    assert status == 0, output
+    System.cmd(executable, [], stderr_to_stdout: true)
+  end
+
+  test "resizing mapped shared memory", ctx do
+    assert {output, status} = run_c_test("lib_remap", ctx)
+    assert status == 0, output
+  end
+
+  test "mapping frozen shared memory", ctx do
+    assert {output, status} = run_c_test("lib_freeze", ctx)
+    assert status == 0, output
+  end
+
+  test "accounting shared memory usage", ctx do
+    assert {output, status} = run_c_test("lib_usage", ctx)
+    assert status == 0, output
+  end
+end
@@ -215,6 +215,406 @@ defmodule Shmex.NativeTest do
     assert @module.read(shm) == {:ok, trimmed_data}
   end
 
+  describe "file I/O" do
+    setup do
+      path = Path.join(System.tmp_dir!(), "shmex_file_test")
+      on_exit(fn -> File.rm(path) end)
+      [path: path]
+    end
+
+    test "from_file/3 reads the whole file", %{data: data, data_size: data_size, path: path} do
+      File.write!(path, data)
+      assert {:ok, shm} = @module.allocate(%Shmex{capacity: 5})
+      assert {:ok, shm} = @module.from_file(shm, path)
+      assert shm.size == data_size
+      assert shm.capacity == data_size
+      assert @module.read(shm) == {:ok, data}
+    end
+
+    test "from_file/3 reads a chunk", %{data: data, path: path} do
+      File.write!(path, data)
+      assert {:ok, shm} = @module.allocate(%Shmex{})
+      assert {:ok, shm} = @module.from_file(shm, path, offset: 5, length: 7)
+      assert @module.read(shm) == {:ok, binary_part(data, 5, 7)}
+      assert {:ok, shm} = @module.from_file(shm, path, offset: 12, length: 100)
+      assert @module.read(shm) == {:ok, binary_part(data, 12, byte_size(data) - 12)}
+    end
+
+    test "from_file/3 does not grow capacity past the end of file", %{data: data, path: path} do
+      File.write!(path, data)
+      rest_size = byte_size(data) - 12
+      assert {:ok, shm} = @module.allocate(%Shmex{capacity: rest_size})
+      assert {:ok, shm} = @module.from_file(shm, path, offset: 12, length: 100)
+      assert shm.capacity == rest_size
+      assert @module.read(shm) == {:ok, binary_part(data, 12, rest_size)}
+    end
+
+    test "from_file/3 when file does not exist", %{path: path} do
+      assert {:ok, shm} = @module.allocate(%Shmex{})
+      assert @module.from_file(shm, path) == {:error, {:enoent, :open}}
+    end
+
+    test "to_file/3 writes the contents", %{data: data, path: path} do
+      File.write!(path, "some longer content that should be truncated")
+      assert {:ok, shm} = @module.allocate(%Shmex{})
+      assert {:ok, shm} = @module.write(shm, data)
+      assert @module.to_file(shm, path) == :ok
+      assert File.read!(path) == data
+    end
+
+    test "to_file/3 writes in chunks", %{data: data, data_size: data_size, path: path} do
+      assert {:ok, shm} = @module.allocate(%Shmex{})
+      assert {:ok, shm} = @module.write(shm, data)
+      assert @module.to_file(shm, path) == :ok
+      assert @module.to_file(shm, path, offset: data_size) == :ok
+      assert File.read!(path) == data <> data
+    end
+
+    test "to_file/3 writes a range", %{data: data, path: path} do
+      assert {:ok, shm} = @module.allocate(%Shmex{})
+      assert {:ok, shm} = @module.write(shm, data)
+      assert @module.to_file(shm, path, source_offset: 5, length: 7) == :ok
+      assert @module.to_file(shm, path, offset: 7, source_offset: 12) == :ok
+      assert File.read!(path) == binary_part(data, 5, byte_size(data) - 5)
+      assert @module.to_file(shm, path, source_offset: 5, length: 100) == {:error, :invalid_range}
+    end
+  end
+
+  describe "sockets" do
+    setup do
+      {:ok, receiver} = :gen_udp.open(0, [:binary, ip: {127, 0, 0, 1}, active: false])
+      {:ok, sender} = :gen_udp.open(0, [:binary, ip: {127, 0, 0, 1}, active: false])
+      {:ok, receiver_port} = :inet.port(receiver)
+      :ok = :gen_udp.connect(sender, {127, 0, 0, 1}, receiver_port)
+      {:ok, receiver_fd} = :inet.getfd(receiver)
+      {:ok, sender_fd} = :inet.getfd(sender)
+      [receiver: receiver, sender: sender, receiver_fd: receiver_fd, sender_fd: sender_fd]
+    end
+
+    test "socket_recv/3", %{sender: sender, receiver_fd: fd, data: data, data_size: data_size} do
+      assert {:ok, shm} = @module.allocate(%Shmex{})
+      assert @module.socket_recv(shm, fd, 0) == {:error, {:eagain, :recv}}
+      :ok = :gen_udp.send(sender, data)
+      assert {:ok, shm} = retry_eagain(fn -> @module.socket_recv(shm, fd, 3) end)
+      assert shm.size == data_size + 3
+      assert {:ok, <<_head::binary-size(3), ^data::binary>>} = @module.read(shm)
+    end
+
+    test "socket_recv_batch/4", %{sender: sender, receiver_fd: fd} do
+      assert {:ok, shm} = @module.allocate(%Shmex{})
+      Enum.each(["a", "bb", "ccc"], &(:ok = :gen_udp.send(sender, &1)))
+      assert recv_batch(shm, fd, 10, 3) == [{"a", false}, {"bb", false}, {"ccc", false}]
+    end
+
+    test "socket_recv_batch/4 reports truncated datagrams", %{sender: sender, receiver_fd: fd} do
+      assert {:ok, shm} = @module.allocate(%Shmex{})
+      :ok = :gen_udp.send(sender, "0123456789")
+      recv = fn -> @module.socket_recv_batch(shm, fd, 4, 1) end
+      assert {:ok, {shm, [{4, true}]}} = retry_eagain(recv)
+      assert shm.size == 4
+      assert @module.read(shm) == {:ok, "0123"}
+    end
+
+    test "socket_send/4", %{receiver: receiver, sender_fd: fd, data: data} do
+      assert {:ok, shm} = @module.allocate(%Shmex{})
+      assert {:ok, shm} = @module.write(shm, data)
+      assert @module.socket_send(shm, fd, 5, 4) == {:ok, 4}
+      assert {:ok, {_address, _port, packet}} = :gen_udp.recv(receiver, 0, 1000)
+      assert packet == binary_part(data, 5, 4)
+      assert @module.socket_send(shm, fd, 5, 100) == {:error, :invalid_range}
+    end
+
+    test "socket_send_batch/3", %{receiver: receiver, sender_fd: fd, data: data} do
+      assert {:ok, shm} = @module.allocate(%Shmex{})
+      assert {:ok, shm} = @module.write(shm, data)
+      assert @module.socket_send_batch(shm, fd, [{0, 4}, {5, 7}]) == {:ok, 2}
+      assert {:ok, {_address, _port, packet}} = :gen_udp.recv(receiver, 0, 1000)
+      assert packet == binary_part(data, 0, 4)
+      assert {:ok, {_address, _port, packet}} = :gen_udp.recv(receiver, 0, 1000)
+      assert packet == binary_part(data, 5, 7)
+    end
+  end
+
+  describe "fill/4" do
+    test "with a byte", %{data: data} do
+      assert {:ok, shm} = @module.allocate(%Shmex{capacity: 16})
+      assert {:ok, shm} = @module.write(shm, data)
+      assert {:ok, shm} = @module.fill(shm, 2, 12, ?x)
+      assert shm.size == 14
+      assert @module.read(shm) == {:ok, binary_part(data, 0, 2) <> String.duplicate("x", 12)}
+    end
+
+    test "with a pattern" do
+      assert {:ok, shm} = @module.allocate(%Shmex{capacity: 16})
+      assert {:ok, shm} = @module.fill(shm, 1, 14, "abc")
+      assert shm.size == 15
+      assert @module.read(shm) == {:ok, <<0>> <> "abcabcabcabcab"}
+    end
+
+    test "beyond size zeroes the gap" do
+      assert {:ok, shm} = @module.allocate(%Shmex{capacity: 16})
+      assert {:ok, shm} = @module.fill(shm, 0, 16, ?x)
+      assert {:ok, shm} = @module.fill(%Shmex{shm | size: 2}, 10, 4, ?y)
+      assert shm.size == 14
+      assert @module.read(shm) == {:ok, "xx" <> <<0::size(8)-unit(8)>> <> "yyyy"}
+    end
+
+    test "with zeros releases whole pages" do
+      capacity = 64 * 4096
+      assert {:ok, shm} = @module.allocate(%Shmex{capacity: capacity})
+      assert {:ok, shm} = @module.fill(shm, 0, capacity, 0xFF)
+      zeros_size = capacity - 2
+      assert {:ok, shm} = @module.fill(shm, 1, zeros_size, 0)
+      assert @module.read(shm) == {:ok, <<0xFF, 0::size(zeros_size)-unit(8), 0xFF>>}
+    end
+
+    test "when range exceeds capacity" do
+      assert {:ok, shm} = @module.allocate(%Shmex{capacity: 16})
+      assert @module.fill(shm, 10, 7, 0) == {:error, :invalid_range}
+      assert @module.fill(shm, 17, 0, 0) == {:error, :invalid_range}
+    end
+
+    test "when shm is frozen" do
+      assert {:ok, shm} = @module.allocate(%Shmex{capacity: 16})
+      assert {:ok, frozen} = @module.freeze(shm)
+      assert @module.fill(frozen, 0, 16, 0) == {:error, :frozen}
+    end
+  end
+
+  describe "freeze/1" do
+    test "marks shm as frozen and keeps it readable", %{data: data} do
+      assert {:ok, shm} = @module.allocate(%Shmex{})
+      assert {:ok, shm} = @module.write(shm, data)
+      assert {:ok, frozen} = @module.freeze(shm)
+      assert frozen.frozen
+      assert @module.read(frozen) == {:ok, data}
+    end
+
+    test "prevents modifications", %{data: data} do
+      assert {:ok, shm} = @module.allocate(%Shmex{})
+      assert {:ok, shm} = @module.write(shm, data)
+      assert {:ok, frozen} = @module.freeze(shm)
+      assert @module.write(frozen, data) == {:error, :frozen}
+      assert @module.append(frozen, frozen) == {:error, :frozen}
+      assert @module.set_capacity(frozen, 10) == {:error, :frozen}
+      assert @module.trim(frozen, 2) == {:error, :frozen}
+      assert @module.set_numa_policy(frozen, {:bind, 0}) == {:error, :frozen}
+      assert @module.set_numa_policy(frozen, :interleave) == {:error, :frozen}
+      assert @module.read(frozen) == {:ok, data}
+    end
+
+    test "prevents modifications through not frozen copies", %{data: data} do
+      assert {:ok, shm} = @module.allocate(%Shmex{})
+      assert {:ok, shm} = @module.write(shm, data)
+      assert {:ok, frozen} = @module.freeze(shm)
+      assert @module.write(shm, data) == {:error, :frozen}
+      assert @module.write(%Shmex{frozen | frozen: false}, data) == {:error, :frozen}
+      assert @module.set_capacity(shm, 10) == {:error, :frozen}
+      assert @module.fill(shm, 0, 4, 0) == {:error, :frozen}
+      assert @module.read(shm) == {:ok, data}
+    end
+
+    @tag :shm_tmpfs
+    test "makes shm read-only" do
+      assert {:ok, shm} = @module.allocate(%Shmex{name: @shm_name})
+      assert {:ok, _frozen} = @module.freeze(shm)
+      assert {:ok, stat} = File.stat(@shm_path)
+      assert Bitwise.band(stat.mode, 0o777) == 0o444
+    end
+  end
+
+  describe "slab" do
+    test "slab_allocate/1 returns independent chunks", %{data: data} do
+      assert {:ok, slab} = @module.slab_create(100, 2)
+      assert {:ok, chunk_a} = @module.slab_allocate(slab)
+      assert {:ok, chunk_b} = @module.slab_allocate(slab)
+      assert chunk_a.name == chunk_b.name
+      assert chunk_a.offset != chunk_b.offset
+      assert chunk_a.capacity == 128
+
+      assert {:ok, chunk_a} = @module.write(chunk_a, data)
+      assert {:ok, chunk_b} = @module.write(chunk_b, "other data")
+      assert @module.read(chunk_a) == {:ok, data}
+      assert @module.read(chunk_b) == {:ok, "other data"}
+    end
+
+    test "slab_allocate/1 when slab is full" do
+      assert {:ok, slab} = @module.slab_create(100, 1)
+      assert {:ok, chunk} = @module.slab_allocate(slab)
+      assert @module.slab_allocate(slab) == {:error, :slab_full}
+      @module.ensure_not_gc(chunk)
+    end
+
+    test "chunks are returned to the slab when garbage collected" do
+      assert {:ok, slab} = @module.slab_create(100, 1)
+
+      task =
+        Task.async(fn ->
+          {:ok, _chunk} = @module.slab_allocate(slab)
+          :ok
+        end)
+
+      monitor = Process.monitor(task.pid)
+      assert Task.await(task) == :ok
+      assert_receive {:DOWN, ^monitor, :process, _pid, _reason}
+
+      assert {:ok, _chunk} = @module.slab_allocate(slab)
+    end
+
+    test "chunks cannot be resized", %{data: data} do
+      assert {:ok, slab} = @module.slab_create(10, 1)
+      assert {:ok, chunk} = @module.slab_allocate(slab)
+      assert @module.set_capacity(chunk, 1000) == {:error, :slab_chunk}
+      assert @module.write(chunk, String.duplicate(data, 10)) == {:error, :slab_chunk}
+      assert @module.freeze(chunk) == {:error, :slab_chunk}
+      assert @module.add_guard(chunk) == {:error, :already_guarded}
+    end
+
+    test "chunks can be trimmed and appended to within their capacity", %{data: data} do
+      assert {:ok, slab} = @module.slab_create(100, 1)
+      assert {:ok, chunk} = @module.slab_allocate(slab)
+      assert {:ok, chunk} = @module.write(chunk, data)
+      assert {:ok, chunk} = @module.trim(chunk, 5)
+      assert chunk.capacity == 128
+      assert @module.read(chunk) == {:ok, binary_part(data, 5, byte_size(data) - 5)}
+
+      assert {:ok, chunk} = @module.append(chunk, Shmex.new("abc"))
+      assert @module.read(chunk) == {:ok, binary_part(data, 5, byte_size(data) - 5) <> "abc"}
+
+      big = Shmex.new(String.duplicate("x", 128))
+      assert @module.append(chunk, big) == {:error, :slab_chunk}
+      assert @module.read(chunk) == {:ok, binary_part(data, 5, byte_size(data) - 5) <> "abc"}
+    end
+  end
+
+  describe "NUMA" do
+    @describetag :numa
+
+    test "set_numa_policy/2 binds memory to the node" do
+      assert {:ok, shm} = @module.allocate(%Shmex{capacity: 3 * 4096})
+      assert @module.set_numa_policy(shm, {:bind, 0}) == :ok
+      assert @module.numa_node(shm) == {:ok, 0}
+    end
+
+    test "set_numa_policy/2 with invalid node" do
+      assert {:ok, shm} = @module.allocate(%Shmex{})
+      assert @module.set_numa_policy(shm, {:bind, 64}) == {:error, {:einval, :mbind}}
+    end
+
+    test "set_numa_policy/2 with interleave policy" do
+      assert {:ok, shm} = @module.allocate(%Shmex{})
+      assert @module.set_numa_policy(shm, :interleave) == :ok
+      assert {:ok, node} = @module.numa_node(shm)
+      assert is_integer(node)
+    end
+  end
+
+  describe "budget" do
+    setup do
+      on_exit(fn -> @module.set_budget(:infinity) end)
+    end
+
+    test "allocations exceeding the budget fail" do
+      {:ok, %{usage: usage}} = @module.usage()
+      assert @module.set_budget(usage + 10_000) == :ok
+      assert {:ok, shm} = @module.allocate(%Shmex{capacity: 8000})
+      assert {:ok, %{usage: new_usage, budget: budget}} = @module.usage()
+      assert new_usage == usage + 8000
+      assert budget == usage + 10_000
+      assert @module.allocate(%Shmex{capacity: 8000}) == {:error, :budget_exceeded}
+      assert @module.set_capacity(shm, 20_000) == {:error, :budget_exceeded}
+      assert {:ok, _shm} = @module.set_capacity(shm, 9000)
+    end
+
+    @tag :shm_tmpfs
+    test "segments guarded with add_guard/1 are not included in usage" do
+      {:ok, %{usage: usage}} = @module.usage()
+      assert File.touch(@shm_path) == :ok
+
+      task =
+        Task.async(fn ->
+          {:ok, shm} = @module.add_guard(%Shmex{name: @shm_name, capacity: 1})
+          {:ok, _shm} = @module.set_capacity(shm, 100_000)
+          :ok
+        end)
+
+      monitor = Process.monitor(task.pid)
+      assert Task.await(task) == :ok
+      assert_receive {:DOWN, ^monitor, :process, _pid, _reason}
+      assert {:ok, %{usage: ^usage}} = @module.usage()
+    end
+
+    test "subscribers are notified when crossing watermarks" do
+      {:ok, %{usage: usage}} = @module.usage()
+      watermark = usage + 5000
+      assert @module.subscribe_usage(watermark) == {:ok, :below}
+
+      task =
+        Task.async(fn ->
+          {:ok, _shm} = @module.allocate(%Shmex{capacity: 6000})
+          :ok
+        end)
+
+      assert Task.await(task) == :ok
+      assert_receive {:shmex_usage, :above, ^watermark, _usage}
+      :erlang.garbage_collect()
+      {:ok, _shm} = @module.allocate(%Shmex{capacity: 1})
+      assert_receive {:shmex_usage, :below, ^watermark, _usage}
+      assert @module.unsubscribe_usage() == :ok
+    end
+  end
+
+  test "alloc_stats/0 and reset_alloc_stats/0" do
+    assert @module.reset_alloc_stats() == :ok
+    assert {:ok, shm} = @module.allocate(%Shmex{})
+    assert {:ok, stats} = @module.alloc_stats()
+    assert stats.allocations == 1
+    assert stats.failures == 0
+    @module.ensure_not_gc(shm)
+
+    assert @module.reset_alloc_stats() == :ok
+    assert {:ok, %{allocations: 0, name_retries: 0}} = @module.alloc_stats()
+  end
+
+  defp retry_eagain(fun, attempts \\ 100) do
+    case fun.() do
+      {:error, {:eagain, _op}} when attempts > 0 ->
+        Process.sleep(1)
+        retry_eagain(fun, attempts - 1)
+
+      result ->
+        result
+    end
+  end
+
+  # Receives `count` datagrams, possibly with multiple calls, failing after the deadline
+  defp recv_batch(shm, fd, slot_size, count, deadline \\ nil) do
+    deadline = deadline || System.monotonic_time(:millisecond) + 1000
+
+    case @module.socket_recv_batch(shm, fd, slot_size, count) do
+      {:ok, {shm, datagrams}} ->
+        assert {:ok, data} = @module.read(shm)
+        assert shm.size == (length(datagrams) - 1) * slot_size + elem(List.last(datagrams), 0)
+
+        received =
+          datagrams
+          |> Enum.with_index()
+          |> Enum.map(fn {{length, truncated?}, i} ->
+            {binary_part(data, i * slot_size, length), truncated?}
+          end)
+
+        case count - length(received) do
+          0 -> received
+          rest -> received ++ recv_batch(shm, fd, slot_size, rest, deadline)
+        end
+
+      {:error, {:eagain, :recv}} ->
+        assert System.monotonic_time(:millisecond) < deadline, "datagrams not received in time"
+        Process.sleep(1)
+        recv_batch(shm, fd, slot_size, count, deadline)
+    end
+  end
+
   @spec testing_data(any()) :: [data: String.t(), data_size: non_neg_integer()]
   def testing_data(_ctx) do
     data = "some testing data"
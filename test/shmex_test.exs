@@ -0,0 +1,23 @@
+defmodule ShmexTest do
+  use ExUnit.Case, async: true
+
+  test "to_compact/1 and from_compact/1" do
+    shm = Shmex.new("some testing data")
+    assert {:shmex, name, guard, 17, 17, 0, false} = Shmex.to_compact(shm)
+    assert name == shm.name
+    assert guard == shm.guard
+    assert shm |> Shmex.to_compact() |> Shmex.from_compact() == shm
+  end
+
+  test "native functions accept the compact form" do
+    shm = Shmex.new("some testing data")
+    assert Shmex.Native.read(Shmex.to_compact(shm), 4) == {:ok, "some"}
+  end
+
+  test "empty/2 with zeroed option" do
+    shm = Shmex.empty(100, zeroed: true)
+    assert shm.size == 100
+    assert Shmex.Native.read(shm) == {:ok, <<0::800>>}
+    assert Shmex.empty(100).size == 0
+  end
+end
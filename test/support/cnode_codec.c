@@ -0,0 +1,52 @@
+// Reads a Shmex struct encoded with `:erlang.term_to_binary/1` from the file
+// passed as the first argument, decodes it with `shmex_deserialize_into` and
+// writes it back as `{compact, map}`, encoded with `shmex_serialize_compact`
+// and `shmex_serialize`, to the file passed as the second argument.
+#include <shmex/shmex.h>
+#include <stdio.h>
+
+int main(int argc, char *argv[]) {
+  if (argc != 3) {
+    return 2;
+  }
+
+  if (ei_init()) {
+    return 2;
+  }
+
+  char buf[4096];
+  FILE *in = fopen(argv[1], "rb");
+  if (in == NULL) {
+    return 2;
+  }
+  size_t len = fread(buf, 1, sizeof(buf), in);
+  fclose(in);
+  if (len == 0) {
+    return 2;
+  }
+
+  int idx = 0;
+  int version;
+  Shmex payload;
+  ShmexStorage storage;
+  if (ei_decode_version(buf, &idx, &version) ||
+      shmex_deserialize_into(buf, &idx, &payload, &storage)) {
+    return 1;
+  }
+
+  ei_x_buff out;
+  if (ei_x_new_with_version(&out) || ei_x_encode_tuple_header(&out, 2) ||
+      shmex_serialize_compact(&out, &payload) ||
+      shmex_serialize(&out, &payload)) {
+    return 1;
+  }
+
+  FILE *out_file = fopen(argv[2], "wb");
+  if (out_file == NULL) {
+    return 2;
+  }
+  fwrite(out.buff, 1, out.index, out_file);
+  fclose(out_file);
+  ei_x_free(&out);
+  return 0;
+}
@@ -0,0 +1,43 @@
+// Checks that frozen shared memory cannot be mapped for writing, also through
+// a copy of the payload made before freezing.
+// Exits with 0 on success and prints the failed condition otherwise.
+#include <shmex/lib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define CHECK(COND)                                                            \
+  do {                                                                         \
+    if (!(COND)) {                                                             \
+      fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #COND);               \
+      result = 1;                                                              \
+      goto exit;                                                               \
+    }                                                                          \
+  } while (0)
+
+int main(void) {
+  int result = 0;
+  Shmex payload;
+  memset(&payload, 0, sizeof(payload));
+  payload.capacity = 4096;
+  payload.mapped_memory = MAP_FAILED;
+
+  CHECK(shmex_allocate_unguarded(&payload) == SHMEX_RES_OK);
+  Shmex stale = payload;
+  CHECK(shmex_freeze(&payload) == SHMEX_RES_OK);
+
+  CHECK(shmex_open_and_mmap(&payload) == SHMEX_ERROR_FROZEN);
+  CHECK(payload.mapped_memory == MAP_FAILED);
+  CHECK(shmex_open_and_mmap(&stale) == SHMEX_ERROR_FROZEN);
+  CHECK(shmex_set_capacity(&stale, 8192) == SHMEX_ERROR_FROZEN);
+
+  CHECK(shmex_open_and_mmap_readonly(&stale) == SHMEX_RES_OK);
+  shmex_unmap(&stale);
+
+exit:
+  if (payload.name != NULL) {
+    shmex_shm_unlink(payload.name);
+    free(payload.name);
+  }
+  return result;
+}
@@ -0,0 +1,84 @@
+// Checks resizing shared memory while it is mapped with 'shmex_set_capacity'.
+// Exits with 0 on success and prints the failed condition otherwise.
+#include <shmex/lib.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define CHECK(COND)                                                            \
+  do {                                                                         \
+    if (!(COND)) {                                                             \
+      fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #COND);               \
+      result = 1;                                                              \
+      goto exit;                                                               \
+    }                                                                          \
+  } while (0)
+
+static int all_equal(const char *memory, size_t size, char value) {
+  for (size_t i = 0; i < size; i++) {
+    if (memory[i] != value) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// returns whether writing to the memory crashes the process
+static int write_crashes(char *memory) {
+  pid_t pid = fork();
+  if (pid == 0) {
+    memory[0] = 'x';
+    _exit(0);
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  return WIFSIGNALED(status) &&
+         (WTERMSIG(status) == SIGSEGV || WTERMSIG(status) == SIGBUS);
+}
+
+int main(void) {
+  int result = 0;
+  size_t page_size = sysconf(_SC_PAGESIZE);
+  Shmex payload;
+  memset(&payload, 0, sizeof(payload));
+  payload.capacity = page_size;
+  payload.mapped_memory = MAP_FAILED;
+
+  CHECK(shmex_allocate_unguarded(&payload) == SHMEX_RES_OK);
+  CHECK(shmex_open_and_mmap(&payload) == SHMEX_RES_OK);
+  memset(payload.mapped_memory, 'a', page_size);
+  payload.size = page_size;
+
+  // growing keeps the data and makes the new part accessible
+  CHECK(shmex_set_capacity(&payload, 3 * page_size) == SHMEX_RES_OK);
+  CHECK(payload.capacity == 3 * page_size);
+  CHECK(all_equal(payload.mapped_memory, page_size, 'a'));
+  memset((char *)payload.mapped_memory + page_size, 'b', 2 * page_size);
+  shmex_unmap(&payload);
+
+  // read-only mapping stays read-only after resizing
+  CHECK(shmex_open_and_mmap_readonly(&payload) == SHMEX_RES_OK);
+  CHECK(all_equal((char *)payload.mapped_memory + page_size, 2 * page_size,
+                  'b'));
+  CHECK(shmex_set_capacity(&payload, 2 * page_size) == SHMEX_RES_OK);
+  CHECK(payload.size == page_size);
+  CHECK(all_equal(payload.mapped_memory, page_size, 'a'));
+  CHECK(all_equal((char *)payload.mapped_memory + page_size, page_size, 'b'));
+  CHECK(write_crashes(payload.mapped_memory));
+
+  // shrinking below size discards the data
+  CHECK(shmex_set_capacity(&payload, page_size / 2) == SHMEX_RES_OK);
+  CHECK(payload.size == page_size / 2);
+  CHECK(all_equal(payload.mapped_memory, page_size / 2, 'a'));
+
+exit:
+  shmex_unmap(&payload);
+  if (payload.name != NULL) {
+    shmex_shm_unlink(payload.name);
+    free(payload.name);
+  }
+  return result;
+}
@@ -0,0 +1,83 @@
+// Checks accounting of the shared memory usage when resizing and unlinking.
+// Exits with 0 on success and prints the failed condition otherwise.
+#include <fcntl.h>
+#include <shmex/lib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define CHECK(COND)                                                            \
+  do {                                                                         \
+    if (!(COND)) {                                                             \
+      fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #COND);               \
+      result = 1;                                                              \
+      goto exit;                                                               \
+    }                                                                          \
+  } while (0)
+
+static void init(Shmex *payload, size_t capacity) {
+  memset(payload, 0, sizeof(*payload));
+  payload->capacity = capacity;
+  payload->mapped_memory = MAP_FAILED;
+}
+
+// resizes the segment behind Shmex's back, like another OS process could
+static int resize_externally(Shmex *payload, size_t size) {
+  int fd = shm_open(payload->name, O_RDWR, 0666);
+  if (fd < 0) {
+    return -1;
+  }
+  int res = ftruncate(fd, size);
+  close(fd);
+  return res;
+}
+
+int main(void) {
+  int result = 0;
+  size_t page_size = sysconf(_SC_PAGESIZE);
+  Shmex payload, other;
+  init(&payload, page_size);
+  init(&other, page_size);
+
+  CHECK(shmex_allocate_unguarded(&payload) == SHMEX_RES_OK);
+  CHECK(shmex_get_usage() == page_size);
+
+  // the change of capacity is accounted, regardless of the segment's size
+  CHECK(resize_externally(&payload, 4 * page_size) == 0);
+  CHECK(shmex_set_capacity(&payload, 3 * page_size) == SHMEX_RES_OK);
+  CHECK(shmex_get_usage() == 3 * page_size);
+
+  // the accounted size can be kept apart from the payload
+  uint64_t accounted_size = payload.capacity;
+  CHECK(shmex_set_capacity_accounted(&payload, 2 * page_size,
+                                     &accounted_size) == SHMEX_RES_OK);
+  CHECK(accounted_size == 2 * page_size);
+  CHECK(shmex_get_usage() == 2 * page_size);
+
+  CHECK(shmex_set_capacity_unaccounted(&payload, 5 * page_size) ==
+        SHMEX_RES_OK);
+  CHECK(shmex_get_usage() == 2 * page_size);
+  shmex_release_usage(3 * page_size);
+  CHECK(shmex_get_usage() == 0);
+
+  // unlinking is accounted only on demand
+  CHECK(shmex_allocate_unguarded(&other) == SHMEX_RES_OK);
+  CHECK(shmex_get_usage() == page_size);
+  CHECK(shmex_unlink(&payload) == SHMEX_RES_OK);
+  CHECK(shmex_get_usage() == page_size);
+  CHECK(resize_externally(&other, 2 * page_size) == 0);
+  CHECK(shmex_unlink_accounted(&other) == SHMEX_RES_OK);
+  CHECK(shmex_get_usage() == 0);
+
+exit:
+  if (payload.name != NULL) {
+    shm_unlink(payload.name);
+    free(payload.name);
+  }
+  if (other.name != NULL) {
+    shm_unlink(other.name);
+    free(other.name);
+  }
+  return result;
+}
@@ -1,5 +1,19 @@
 ExUnit.start(capture_log: true)
 
-if not File.exists?("/dev/shm") do
-  ExUnit.configure(exclude: [:shm_tmpfs, :shm_resizable])
-end
+excluded_tags =
+  if File.exists?("/dev/shm"), do: [], else: [:shm_tmpfs, :shm_resizable]
+
+excluded_tags =
+  if File.exists?("/sys/devices/system/node/node0"),
+    do: excluded_tags,
+    else: [:numa | excluded_tags]
+
+excluded_tags =
+  if System.find_executable("cc"), do: excluded_tags, else: [:c_compiler | excluded_tags]
+
+excluded_tags =
+  if System.find_executable("cc") && is_list(:code.lib_dir(:erl_interface)),
+    do: excluded_tags,
+    else: [:cnode_codec | excluded_tags]
+
+ExUnit.configure(exclude: excluded_tags)